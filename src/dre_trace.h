@@ -0,0 +1,200 @@
+#ifndef AREAL_SRC_DRE_TRACE_H_
+#define AREAL_SRC_DRE_TRACE_H_
+
+#include <fstream>
+#include <map>
+#include <string>
+
+#include "cyclus.h"
+
+namespace areal {
+
+/// Kinds of record in a DRE trace.  Every record but TRACE_COMP starts with
+/// its kind and the time step, relative to the reactor's entry, that it was
+/// written on.
+enum TraceKind {
+  /// requests passed to GetMatlBids on the reactor's outcommods: commodity
+  /// count, then per commodity its name, request count and each request's
+  /// target quantity.
+  TRACE_BIDS = 'B',
+  /// trades passed to GetMatlTrades: trade count, then per trade the
+  /// request commodity, the region and position in the region's spent fuel
+  /// of the assembly bid, and the amount.
+  TRACE_TRADES = 'T',
+  /// responses passed to AcceptMatlTrades: response count, then per
+  /// response the request commodity, composition index and quantity.
+  TRACE_ACCEPT = 'A',
+  /// a composition used by later records: its index and nuclide masses.
+  TRACE_COMP = 'C',
+  /// the reactor was decommissioned at the end of this time step.
+  TRACE_END = 'E',
+};
+
+/// The first bytes of every DRE trace.
+static const char kTraceMagic[] = "ARDRE001";
+
+/// Writes a DRE trace.  Values are written in the host's binary layout, so a
+/// trace is meant to be replayed on the machine that recorded it.
+class TraceWriter {
+ public:
+  explicit TraceWriter(const std::string& path)
+      : f_(path.c_str(), std::ios::out | std::ios::binary) {
+    if (!f_.is_open()) {
+      throw cyclus::IOError("areal::TraceWriter cannot open " + path);
+    }
+    f_.write(kTraceMagic, sizeof(kTraceMagic) - 1);
+  }
+
+  void Record(TraceKind kind, int time) {
+    f_.put(static_cast<char>(kind));
+    Int(time);
+  }
+
+  void Int(int v) { f_.write(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+  void Double(double v) {
+    f_.write(reinterpret_cast<const char*>(&v), sizeof(v));
+  }
+
+  void String(const std::string& s) {
+    Int(s.size());
+    f_.write(s.data(), s.size());
+  }
+
+  void Comp(const cyclus::CompMap& v) {
+    Int(v.size());
+    cyclus::CompMap::const_iterator it;
+    for (it = v.begin(); it != v.end(); ++it) {
+      Int(it->first);
+      Double(it->second);
+    }
+  }
+
+  /// Returns the index of a composition in the trace, writing a TRACE_COMP
+  /// record for it the first time it is seen.  Must not be called while a
+  /// record is being written.
+  int CompIndex(cyclus::Composition::Ptr c) {
+    std::map<int, int>::iterator it = comps_.find(c->id());
+    if (it != comps_.end()) {
+      return it->second;
+    }
+    int index = comps_.size();
+    comps_[c->id()] = index;
+    f_.put(static_cast<char>(TRACE_COMP));
+    Int(index);
+    Comp(c->mass());
+    return index;
+  }
+
+  void Flush() { f_.flush(); }
+
+ private:
+  std::ofstream f_;
+
+  // trace index of each composition written, by composition id
+  std::map<int, int> comps_;
+};
+
+/// Reads a DRE trace written by TraceWriter.
+class TraceReader {
+ public:
+  explicit TraceReader(const std::string& path)
+      : f_(path.c_str(), std::ios::in | std::ios::binary) {
+    if (!f_.is_open()) {
+      throw cyclus::IOError("areal::TraceReader cannot open " + path);
+    }
+    std::string magic(sizeof(kTraceMagic) - 1, '\0');
+    f_.read(&magic[0], magic.size());
+    if (!f_ || magic != kTraceMagic) {
+      throw cyclus::ValueError("areal::TraceReader " + path +
+                               " is not a DRE trace");
+    }
+  }
+
+  /// Reads the kind of the next record.  Returns false at the end of the
+  /// trace.
+  bool Next(TraceKind* kind) {
+    char c;
+    if (!f_.get(c)) {
+      return false;
+    }
+    *kind = static_cast<TraceKind>(c);
+    return true;
+  }
+
+  int Int() {
+    int v;
+    Read(reinterpret_cast<char*>(&v), sizeof(v));
+    return v;
+  }
+
+  double Double() {
+    double v;
+    Read(reinterpret_cast<char*>(&v), sizeof(v));
+    return v;
+  }
+
+  std::string String() {
+    std::string s(Int(), '\0');
+    if (!s.empty()) {
+      Read(&s[0], s.size());
+    }
+    return s;
+  }
+
+  cyclus::CompMap Comp() {
+    cyclus::CompMap v;
+    int n = Int();
+    for (int i = 0; i < n; i++) {
+      int nuc = Int();
+      v[nuc] = Double();
+    }
+    return v;
+  }
+
+ private:
+  void Read(char* buf, int n) {
+    if (!f_.read(buf, n)) {
+      throw cyclus::ValueError("areal::TraceReader trace is truncated");
+    }
+  }
+
+  std::ifstream f_;
+};
+
+/// What a trace needs to rebuild its reactor: the reactor's input as a
+/// TwoRegionReactor config element body, the time steps it was traced for,
+/// its lifetime and the fuel recipes it names.
+struct TraceHeader {
+  std::string config;
+  int duration;
+  int lifetime;
+  std::map<std::string, cyclus::CompMap> recipes;
+
+  void Write(TraceWriter* w) const {
+    w->String(config);
+    w->Int(duration);
+    w->Int(lifetime);
+    w->Int(recipes.size());
+    std::map<std::string, cyclus::CompMap>::const_iterator it;
+    for (it = recipes.begin(); it != recipes.end(); ++it) {
+      w->String(it->first);
+      w->Comp(it->second);
+    }
+  }
+
+  void Read(TraceReader* r) {
+    config = r->String();
+    duration = r->Int();
+    lifetime = r->Int();
+    int n = r->Int();
+    for (int i = 0; i < n; i++) {
+      std::string name = r->String();
+      recipes[name] = r->Comp();
+    }
+  }
+};
+
+}  // namespace areal
+
+#endif  // AREAL_SRC_DRE_TRACE_H_
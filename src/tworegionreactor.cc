@@ -1,5 +1,11 @@
 #include "tworegionreactor.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+
 using cyclus::Material;
 using cyclus::toolkit::MatVec;
 using cyclus::KeyError;
@@ -8,6 +14,261 @@ using cyclus::Request;
 
 namespace areal {
 
+// Per-phase timing and counting of the reactor's hot paths, compiled in only
+// when AREAL_PROFILE is defined (cmake -DUSE_PROFILING=ON).
+#ifdef AREAL_PROFILE
+#define AREAL_PROFILE_PHASE(phase) PhaseTimer phase_timer(this, phase)
+#define AREAL_PROFILE_COUNT(phase, n) profile_->items[phase] += (n)
+#else
+#define AREAL_PROFILE_PHASE(phase)
+#define AREAL_PROFILE_COUNT(phase, n)
+#endif
+
+enum ProfilePhase {TICK, TOCK, REQUESTS, BIDS, TRADES, ACCEPT, N_PHASES};
+
+// Wall time, calls and items produced (requests, bids or trades) for each
+// phase, summed over the run.
+struct TwoRegionReactor::Profile {
+  Profile() : recorded(false) {
+    for (int i = 0; i < N_PHASES; i++) {
+      seconds[i] = 0;
+      calls[i] = 0;
+      items[i] = 0;
+    }
+  }
+  double seconds[N_PHASES];
+  int calls[N_PHASES];
+  int items[N_PHASES];
+  bool recorded;
+};
+
+#ifdef AREAL_PROFILE
+// Adds the wall time of its scope to a phase of the reactor's profile.  The
+// profile is written when the last Tock of the simulation finishes.
+class TwoRegionReactor::PhaseTimer {
+ public:
+  PhaseTimer(TwoRegionReactor* r, ProfilePhase phase)
+      : r_(r), phase_(phase), start_(std::chrono::steady_clock::now()) {}
+  ~PhaseTimer() {
+    std::chrono::duration<double> dt =
+        std::chrono::steady_clock::now() - start_;
+    r_->profile_->seconds[phase_] += dt.count();
+    ++r_->profile_->calls[phase_];
+    if (phase_ == TOCK && r_->context()->time() ==
+                              r_->context()->sim_info().duration - 1) {
+      r_->RecordProfile();
+    }
+  }
+
+ private:
+  TwoRegionReactor* r_;
+  ProfilePhase phase_;
+  std::chrono::steady_clock::time_point start_;
+};
+#endif
+
+// Returns the object read from a data file for ctx's simulation, reading it
+// with read the first time the file is named in the simulation.  Objects are
+// held weakly, so they are freed with the last reactor using them and a file
+// rewritten between simulations is read again.
+template <class T>
+static boost::shared_ptr<T> LoadShared(
+    cyclus::Context* ctx, const std::string& path,
+    boost::shared_ptr<T> (*read)(const std::string&)) {
+  typedef std::pair<boost::uuids::uuid, std::string> Key;
+  typedef std::map<Key, boost::weak_ptr<T> > Cache;
+  static Cache loaded;
+
+  typename Cache::iterator it = loaded.begin();
+  while (it != loaded.end()) {
+    if (it->second.expired()) {
+      loaded.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  boost::weak_ptr<T>& cached = loaded[Key(ctx->sim_id(), path)];
+  boost::shared_ptr<T> obj = cached.lock();
+  if (!obj) {
+    obj = read(path);
+    cached = obj;
+  }
+  return obj;
+}
+
+// Reads a whitespace separated data file, calling parse on each line that is
+// not blank or a comment (starting with #).  parse returns false if the line
+// is malformed, which is reported with its line number.
+template <class F>
+static void ReadDataFile(const std::string& what, const std::string& path,
+                         F parse) {
+  std::ifstream f(path.c_str());
+  if (!f.is_open()) {
+    throw cyclus::IOError("areal::" + what + " cannot open " + path);
+  }
+  std::string line;
+  int n_line = 0;
+  while (std::getline(f, line)) {
+    n_line++;
+    std::string::size_type start = line.find_first_not_of(" \t\r");
+    if (start == std::string::npos || line[start] == '#') {
+      continue;  // blank or comment
+    }
+    std::stringstream ss(line);
+    if (!parse(ss)) {
+      std::stringstream msg;
+      msg << "areal::" << what << " bad entry on line " << n_line << " of "
+          << path;
+      throw ValueError(msg.str());
+    }
+  }
+}
+
+DepletionMatrix::Ptr DepletionMatrix::Load(cyclus::Context* ctx,
+                                           const std::string& path) {
+  return LoadShared(ctx, path, &DepletionMatrix::Read);
+}
+
+DepletionMatrix::Ptr DepletionMatrix::Read(const std::string& path) {
+  Ptr m(new DepletionMatrix());
+  ReadDataFile("DepletionMatrix", path, [&m](std::stringstream& ss) {
+    std::string from;
+    std::string to;
+    double frac;
+    if (!(ss >> from >> to >> frac) || frac < 0) {
+      return false;
+    }
+    m->entries_[pyne::nucname::id(from)].push_back(
+        std::make_pair(pyne::nucname::id(to), frac));
+    return true;
+  });
+
+  // a step must neither lose nor gain mass
+  std::map<int, std::vector<std::pair<int, double> > >::iterator it;
+  for (it = m->entries_.begin(); it != m->entries_.end(); ++it) {
+    double total = 0;
+    for (int j = 0; j < it->second.size(); j++) {
+      total += it->second[j].second;
+    }
+    if (std::abs(total - 1) > 1e-6) {
+      std::stringstream msg;
+      msg << "areal::DepletionMatrix fractions of nuclide " << it->first
+          << " in " << path << " sum to " << total << " instead of 1";
+      throw ValueError(msg.str());
+    }
+  }
+  return m;
+}
+
+cyclus::Composition::Ptr DepletionMatrix::Deplete(cyclus::Composition::Ptr c,
+                                                  int n_steps) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (next_.size() > kMaxCached) {
+    next_.clear();  // keep the cache bounded however many fuels pass through
+  }
+  for (int i = 0; i < n_steps; i++) {
+    cyclus::Composition::Ptr& next = next_[c->id()];
+    if (!next) {
+      next = Step(c);
+    }
+    c = next;
+  }
+  return c;
+}
+
+cyclus::Composition::Ptr DepletionMatrix::Step(
+    cyclus::Composition::Ptr c) const {
+  const cyclus::CompMap& v = c->mass();
+  cyclus::CompMap out;
+  cyclus::CompMap::const_iterator it;
+  for (it = v.begin(); it != v.end(); ++it) {
+    std::map<int, std::vector<std::pair<int, double> > >::const_iterator col =
+        entries_.find(it->first);
+    if (col == entries_.end()) {
+      out[it->first] += it->second;
+      continue;
+    }
+    for (int j = 0; j < col->second.size(); j++) {
+      out[col->second[j].first] += col->second[j].second * it->second;
+    }
+  }
+  return cyclus::Composition::CreateFromMass(out);
+}
+
+BurnupLibrary::Ptr BurnupLibrary::Load(cyclus::Context* ctx,
+                                       const std::string& path) {
+  return LoadShared(ctx, path, &BurnupLibrary::Read);
+}
+
+BurnupLibrary::Ptr BurnupLibrary::Read(const std::string& path) {
+  std::map<int, cyclus::CompMap> entries;
+  ReadDataFile("BurnupLibrary", path, [&entries](std::stringstream& ss) {
+    int steps;
+    std::string nuc;
+    double mass;
+    if (!(ss >> steps >> nuc >> mass) || steps < 0 || mass < 0) {
+      return false;
+    }
+    entries[steps][pyne::nucname::id(nuc)] += mass;
+    return true;
+  });
+  if (entries.empty()) {
+    throw ValueError("areal::BurnupLibrary has no entries in " + path);
+  }
+
+  // entries are interpolated by mass fraction
+  std::map<int, cyclus::CompMap>::iterator it;
+  for (it = entries.begin(); it != entries.end(); ++it) {
+    double total = 0;
+    cyclus::CompMap::iterator nuc;
+    for (nuc = it->second.begin(); nuc != it->second.end(); ++nuc) {
+      total += nuc->second;
+    }
+    if (total <= 0) {
+      std::stringstream msg;
+      msg << "areal::BurnupLibrary entry " << it->first << " of " << path
+          << " has no mass";
+      throw ValueError(msg.str());
+    }
+    for (nuc = it->second.begin(); nuc != it->second.end(); ++nuc) {
+      nuc->second /= total;
+    }
+  }
+
+  // the composition of every burnup the library covers is built now, so the
+  // library is never modified once shared
+  Ptr l(new BurnupLibrary());
+  l->first_ = entries.begin()->first;
+  int last = entries.rbegin()->first;
+  for (int n = l->first_; n <= last; n++) {
+    std::map<int, cyclus::CompMap>::const_iterator hi = entries.lower_bound(n);
+    if (hi->first == n) {
+      l->spent_.push_back(cyclus::Composition::CreateFromMass(hi->second));
+      continue;
+    }
+    std::map<int, cyclus::CompMap>::const_iterator lo = hi;
+    --lo;
+    double w = static_cast<double>(n - lo->first) / (hi->first - lo->first);
+    cyclus::CompMap v;
+    cyclus::CompMap::const_iterator nuc;
+    for (nuc = lo->second.begin(); nuc != lo->second.end(); ++nuc) {
+      v[nuc->first] += (1 - w) * nuc->second;
+    }
+    for (nuc = hi->second.begin(); nuc != hi->second.end(); ++nuc) {
+      v[nuc->first] += w * nuc->second;
+    }
+    l->spent_.push_back(cyclus::Composition::CreateFromMass(v));
+  }
+  return l;
+}
+
+cyclus::Composition::Ptr BurnupLibrary::Spent(int n_steps) const {
+  // burnups outside the library get its first or last entry
+  int last = first_ + static_cast<int>(spent_.size()) - 1;
+  return spent_[std::max(first_, std::min(n_steps, last)) - first_];
+}
+
 TwoRegionReactor::TwoRegionReactor(cyclus::Context* ctx)
     : cyclus::Facility(ctx),
       cycle_time(0),
@@ -15,9 +276,15 @@ TwoRegionReactor::TwoRegionReactor(cyclus::Context* ctx)
       cycle_step(0),
       power_cap(0),
       power_name("power"),
-      discharged1(false),
-      discharged2(false),
-      keep_packaging(true) {}
+      keep_packaging(true),
+      aggregate_requests(false),
+      prune_bids(false),
+      demand_per_assembly(false),
+      quiet_until_(-1) {
+#ifdef AREAL_PROFILE
+  profile_.reset(new Profile());
+#endif
+}
 
 
 #pragma cyclus def clone areal::TwoRegionReactor
@@ -28,13 +295,26 @@ TwoRegionReactor::TwoRegionReactor(cyclus::Context* ctx)
 
 #pragma cyclus def infiletodb areal::TwoRegionReactor
 
-#pragma cyclus def snapshot areal::TwoRegionReactor
-
-#pragma cyclus def snapshotinv areal::TwoRegionReactor
-
-#pragma cyclus def initinv areal::TwoRegionReactor
+void TwoRegionReactor::Snapshot(cyclus::DbInit di) {
+  // the core assemblies' load counts are kept per region while running
+  core_loaded_at.clear();
+  for (int i = 0; i < n_regions(); i++) {
+    Region& r = regions_[i];
+    core_loaded_at.insert(core_loaded_at.end(), r.core_loaded_at.begin(),
+                          r.core_loaded_at.end());
+  }
+  #pragma cyclus impl snapshot areal::TwoRegionReactor
+}
 
 void TwoRegionReactor::InitFrom(TwoRegionReactor* m) {
+  // clones share the spec of the reactor they are copied from, which is
+  // built the first time a prototype is cloned
+  if (!m->spec_) {
+    m->CheckRegionVars();
+    m->spec_ = m->BuildSpec();
+  }
+  spec_ = m->spec_;
+
   #pragma cyclus impl initfromcopy areal::TwoRegionReactor
   cyclus::toolkit::CommodityProducer::Copy(m);
 }
@@ -47,62 +327,226 @@ void TwoRegionReactor::InitFrom(cyclus::QueryableBackend* b) {
                              tk::CommodInfo(power_cap, power_cap));
 }
 
+cyclus::Inventories TwoRegionReactor::SnapshotInv() {
+  // region inventories are named fresh1, core1, spent1, fresh2, ... so that
+  // snapshots of two region reactors keep their original layout.
+  cyclus::Inventories invs;
+  for (int i = 0; i < n_regions(); i++) {
+    Region& r = regions_[i];
+    std::stringstream ss;
+    ss << i + 1;
+    std::vector<cyclus::Resource::Ptr>& fresh = invs["fresh" + ss.str()];
+    fresh = r.fresh.PopNRes(r.fresh.count());
+    r.fresh.Push(fresh);
+
+    // the core and spent fuel are copied from their ordered views rather
+    // than popped and re-pushed, and keep the order they are used in
+    invs["core" + ss.str()].assign(r.core_mats.begin(), r.core_mats.end());
+    invs["spent" + ss.str()].assign(r.spent_mats.begin(), r.spent_mats.end());
+  }
+  return invs;
+}
+
+void TwoRegionReactor::InitInv(cyclus::Inventories& inv) {
+  InitRegions();
+
+  // when each core assembly was loaded is restored if it was snapshotted
+  // with the inventories
+  int n_core = 0;
+  for (int i = 0; i < n_regions(); i++) {
+    std::stringstream ss;
+    ss << i + 1;
+    n_core += inv["core" + ss.str()].size();
+  }
+  bool restore_loaded_at = core_loaded_at.size() == n_core;
+  std::vector<int>::iterator loaded_at = core_loaded_at.begin();
+
+  for (int i = 0; i < n_regions(); i++) {
+    Region& r = regions_[i];
+    std::stringstream ss;
+    ss << i + 1;
+    r.fresh.Push(inv["fresh" + ss.str()]);
+
+    std::vector<cyclus::Resource::Ptr>& core = inv["core" + ss.str()];
+    MatVec mats;
+    for (int j = 0; j < core.size(); j++) {
+      mats.push_back(cyclus::ResCast<Material>(core[j]));
+    }
+    LoadCore(mats, i);
+    if (restore_loaded_at) {
+      std::copy(loaded_at, loaded_at + mats.size(),
+                r.core_loaded_at.end() - mats.size());
+      loaded_at += mats.size();
+    }
+
+    std::vector<cyclus::Resource::Ptr>& spent = inv["spent" + ss.str()];
+    mats.clear();
+    for (int j = 0; j < spent.size(); j++) {
+      mats.push_back(cyclus::ResCast<Material>(spent[j]));
+    }
+    StoreSpent(mats, i);
+  }
+}
+
 void TwoRegionReactor::EnterNotify() {
   cyclus::Facility::EnterNotify();
-  // Set keep packaging parameter in all ResBufs
-  fresh1.keep_packaging(keep_packaging);
-  core1.keep_packaging(keep_packaging);
-  spent1.keep_packaging(keep_packaging);
-  fresh2.keep_packaging(keep_packaging);
-  core2.keep_packaging(keep_packaging);
-  spent2.keep_packaging(keep_packaging);
-
-  // Throw error if vectors do not have size 2
-  if (fuel_incommods.size() != 2) {
+  InitRegions();
+  InitializePosition();
+  if (!dre_trace.empty()) {
+    OpenTrace();
+  }
+}
+
+// Throws if a per-region input vector does not have one entry per region.
+template <class T>
+static void CheckRegionVar(const std::vector<T>& v, int n_regions,
+                           std::string name) {
+  if (v.size() != n_regions) {
+    std::stringstream ss;
+    ss << "areal::TwoRegionReactor " << name << " does not have "
+       << n_regions << " entries (one per region)";
+    throw cyclus::ValueError(ss.str());
+  }
+}
+
+void TwoRegionReactor::InitRegions() {
+  CheckRegionVars();
+  if (!spec_) {
+    spec_ = BuildSpec();
+  }
+
+  int n = spec_->regions.size();
+  if (regions_.size() == n) {
+    return;
+  }
+
+  regions_.resize(n);
+  for (int i = 0; i < n; i++) {
+    Region& r = regions_[i];
+    r.spec = &spec_->regions[i];
+
+    r.fresh.capacity(r.spec->n_assem_fresh * r.spec->assem_size);
+    r.core.capacity(r.spec->n_assem_core * r.spec->assem_size);
+    r.spent.capacity(r.spec->n_assem_spent * r.spec->assem_size);
+
+    // Set keep packaging parameter in all ResBufs
+    r.fresh.keep_packaging(keep_packaging);
+    r.core.keep_packaging(keep_packaging);
+    r.spent.keep_packaging(keep_packaging);
+  }
+}
+
+void TwoRegionReactor::CheckRegionVars() {
+  int n = fuel_incommods.size();
+  if (n == 0) {
     throw cyclus::ValueError("areal::TwoRegionReactor fuel_incommods "\
-                             "does not have 2 entries");
+                             "must have at least one entry");
   }
-  if (fuel_outcommods.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor fuel_outcommods "\
-                             "does not have 2 entries");
+
+  // optional per-region inputs default to the same value for every region
+  if (n_assem_fresh.empty()) {
+    n_assem_fresh.assign(n, 0);
+  }
+  if (n_assem_spent.empty()) {
+    n_assem_spent.assign(n, 1000000000);
   }
-  if (fuel_inrecipes.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor fuel_inrecipes "\
-                             "does not have 2 entries");
+  if (discharged.empty()) {
+    discharged.assign(n, 0);
   }
-  if (fuel_outrecipes.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor fuel_outrecipes "\
-                             "does not have 2 entries");
+  if (depletion_files.empty()) {
+    depletion_files.assign(n, "");
   }
-  if (assem_size.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor assem_size "\
-                             "does not have 2 entries");
+  if (burnup_libraries.empty()) {
+    burnup_libraries.assign(n, "");
   }
-  if (n_assem_batch.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor n_assem_batch "\
-                             "does not have 2 entries");
+  if (burn_steps.empty()) {
+    burn_steps.assign(n, 0);
   }
-  if (n_assem_region.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor n_assem_region "\
-                             "does not have 2 entries");
+
+  // Throw error if vectors do not have one entry per region
+  CheckRegionVar(fuel_outcommods, n, "fuel_outcommods");
+  CheckRegionVar(fuel_inrecipes, n, "fuel_inrecipes");
+  CheckRegionVar(fuel_outrecipes, n, "fuel_outrecipes");
+  CheckRegionVar(assem_size, n, "assem_size");
+  CheckRegionVar(n_assem_batch, n, "n_assem_batch");
+  CheckRegionVar(n_assem_region, n, "n_assem_region");
+  CheckRegionVar(n_assem_fresh, n, "n_assem_fresh");
+  CheckRegionVar(n_assem_spent, n, "n_assem_spent");
+  CheckRegionVar(discharged, n, "discharged");
+  CheckRegionVar(depletion_files, n, "depletion_files");
+  CheckRegionVar(burnup_libraries, n, "burnup_libraries");
+  CheckRegionVar(burn_steps, n, "burn_steps");
+}
+
+boost::shared_ptr<const TwoRegionReactor::Spec>
+TwoRegionReactor::BuildSpec() const {
+  boost::shared_ptr<Spec> spec(new Spec());
+  int n = fuel_incommods.size();
+  spec->regions.resize(n);
+  for (int i = 0; i < n; i++) {
+    RegionSpec& r = spec->regions[i];
+    r.assem_size = assem_size[i];
+    r.n_assem_batch = n_assem_batch[i];
+    r.n_assem_core = n_assem_region[i];
+    r.n_assem_fresh = n_assem_fresh[i];
+    r.n_assem_spent = n_assem_spent[i];
+    if (!depletion_files[i].empty() && !burnup_libraries[i].empty()) {
+      throw cyclus::ValueError("areal::TwoRegionReactor a region cannot have "
+                               "both depletion_files and burnup_libraries "
+                               "entries");
+    }
+    if (!depletion_files[i].empty()) {
+      r.depletion = DepletionMatrix::Load(context(), depletion_files[i]);
+    }
+    if (!burnup_libraries[i].empty()) {
+      r.library = BurnupLibrary::Load(context(), burnup_libraries[i]);
+    }
   }
-  if (n_assem_fresh.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor n_assem_fresh "\
-                             "does not have 2 entries");
+  InternCommods(spec.get());
+  ResolveRecipes(spec.get());
+  return spec;
+}
+
+void TwoRegionReactor::ResolveRecipes(Spec* spec) const {
+  for (int i = 0; i < spec->regions.size(); i++) {
+    RegionSpec& r = spec->regions[i];
+    r.inrecipe = context()->GetRecipe(fuel_inrecipes[i]);
+    r.outrecipe = context()->GetRecipe(fuel_outrecipes[i]);
+    r.request_target = Material::CreateUntracked(r.assem_size, r.inrecipe);
+
+    // a region orders at most a full core and a full fresh inventory
+    r.request_caps.clear();
+    for (int n = 1; n <= r.n_assem_core + r.n_assem_fresh; n++) {
+      r.request_caps.push_back(
+          cyclus::CapacityConstraint<Material>(n * r.assem_size));
+    }
   }
-  if (n_assem_spent.size() != 2) {
-    throw cyclus::ValueError("areal::TwoRegionReactor n_assem_spent "\
-                             "does not have 2 entries");
+}
+
+void TwoRegionReactor::Decommission() {
+  RecordProfile();
+  if (trace_) {
+    trace_->Record(TRACE_END, trace_time());
+    trace_->Flush();
   }
-  InitializePosition();
+  cyclus::Facility::Decommission();
 }
 
 bool TwoRegionReactor::CheckDecommissionCondition() {
-  return core1.count() == 0 && spent1.count() == 0 &&
-  core2.count() == 0 && spent2.count() == 0;
+  for (int i = 0; i < n_regions(); i++) {
+    if (regions_[i].core.count() > 0 || regions_[i].spent.count() > 0) {
+      return false;
+    }
+  }
+  return true;
 }
 
 void TwoRegionReactor::Tick() {
+  AREAL_PROFILE_PHASE(TICK);
+  if (context()->time() < quiet_until_) {
+    return;
+  }
+
   // The following code must go in the Tick so they fire on the time step
   // following the cycle_step update - allowing for the all reactor events to
   // occur and be recorded on the "beginning" of a time step.  Another reason
@@ -110,43 +554,26 @@ void TwoRegionReactor::Tick() {
   // can't go at the beginning of the Tock is so that resource exchange has 
   // chance to occur after the discharge on this same time step.
   if (retired()) {
-    Record("RETIRED", "");
+    Record("RETIRED");
     if (context()->time() == exit_time() + 1) { // only need to transmute once
-      if (decom_transmute_all == true) {
-        /// transmute all the fuel in each region
-        for (int i=0; i<2; i++){
-          Transmute(n_assem_region[i], i);
-        }
-      }
-      else {
-        /// transmute half the fuel in each region
-        for (int i=0; i<2; i++){
-          Transmute(ceil(static_cast<double>(n_assem_region[i]) / 2.0), i);
+      for (int i = 0; i < n_regions(); i++) {
+        if (decom_transmute_all == true) {
+          /// transmute all the fuel in the region
+          Transmute(regions_[i].spec->n_assem_core, i);
+        } else {
+          /// transmute half the fuel in the region
+          Transmute(
+              ceil(static_cast<double>(regions_[i].spec->n_assem_core) / 2.0),
+              i);
         }
       }
     }
-    // discharging fuel from each core region. This needs to be in 
-    // separate loops because if the regions have different numbers of 
-    // assemblies then it might break before both regions are fully 
-    // discharged. 
-    while (core1.count() > 0){
-      if (!Discharge(region1_ID)) {
-        break;
-      }
-    }
-    while (core2.count() > 0){
-      if (!Discharge(region2_ID)) {
-        break;
-      }
-    }
-    // in case a cycle lands exactly on our last time step, we will need to
-    // burn a batch from fresh inventory on this time step.  When retired,
-    // this batch also needs to be discharged to spent fuel inventory.
-    while (fresh1.count() > 0 && spent1.space() >= assem_size[region1_ID]) {
-      spent1.Push(fresh1.Pop());
-    }
-    while (fresh2.count() > 0 && spent2.space() >= assem_size[region2_ID]) {
-      spent2.Push(fresh2.Pop());
+    // empty each region's core and fresh fuel into spent fuel inventory.
+    // Each region is emptied separately because if the regions have
+    // different numbers of assemblies then a failed discharge in one region
+    // must not stop the others from being fully discharged.
+    for (int i = 0; i < n_regions(); i++) {
+      DischargeAll(i);
     }
     if(CheckDecommissionCondition()) {
       context()->SchedDecom(this);    
@@ -156,88 +583,93 @@ void TwoRegionReactor::Tick() {
 
   if (cycle_step == cycle_time) {
     Transmute();
-    Record("CYCLE_END", "");
+    Record("CYCLE_END");
   }
 
-  if (cycle_step >= cycle_time && !discharged1 && !discharged2) {
-    discharged1 = Discharge(region1_ID);
-    discharged2 = Discharge(region2_ID);
-  }
   if (cycle_step >= cycle_time) {
-    Load(region1_ID);
-    Load(region2_ID);
+    // regions are only discharged together - once any region has
+    // discharged this cycle no further discharge is attempted.
+    bool any_discharged = false;
+    for (int i = 0; i < n_regions(); i++) {
+      any_discharged = any_discharged || discharged[i];
+    }
+    if (!any_discharged) {
+      for (int i = 0; i < n_regions(); i++) {
+        discharged[i] = Discharge(i);
+      }
+    }
+    for (int i = 0; i < n_regions(); i++) {
+      Load(i);
+    }
   }
-
 }
 
 std::set<cyclus::RequestPortfolio<Material>::Ptr> TwoRegionReactor::GetMatlRequests() {
   // DRE phase 1 -- placing requests
   using cyclus::RequestPortfolio;
+  AREAL_PROFILE_PHASE(REQUESTS);
 
   std::set<RequestPortfolio<Material>::Ptr> ports;
-  Material::Ptr m;
 
-  // second min expression reduces assembles to amount needed until
-  // retirement if it is near.
-  int n_assem_order1 = n_assem_region[region1_ID] - core1.count() + n_assem_fresh[region1_ID] - fresh1.count();
-  int n_assem_order2 = n_assem_region[region2_ID] - core2.count() + n_assem_fresh[region2_ID] - fresh2.count(); 
+  if (retired() || context()->time() < quiet_until_) {
+    return ports;
+  }
 
+  double n_cycles_left = 0;
   if (exit_time() != -1) {
     // the +1 accounts for the fact that the reactor is alive and gets to
     // operate during its exit_time time step.
     int t_left = exit_time() - context()->time() + 1;
     int t_left_cycle = cycle_time + refuel_time - cycle_step;
-    double n_cycles_left = static_cast<double>(t_left - t_left_cycle) /
-                         static_cast<double>(cycle_time + refuel_time);
+    n_cycles_left = static_cast<double>(t_left - t_left_cycle) /
+                    static_cast<double>(cycle_time + refuel_time);
     n_cycles_left = ceil(n_cycles_left);
-
-    int n_need1 = std::max(0.0, n_cycles_left * n_assem_batch[region1_ID] - n_assem_fresh[region1_ID] + n_assem_region[region1_ID] - core1.count());
-
-    int n_need2 = std::max(0.0, n_cycles_left * n_assem_batch[region2_ID] - n_assem_fresh[region2_ID] + n_assem_region[region2_ID] - core2.count());
-
-    n_assem_order1 = std::min(n_assem_order1, n_need1);
-    n_assem_order2 = std::min(n_assem_order2, n_need2); 
-  }
-  
-  if (n_assem_order1 == 0 && n_assem_order2 == 0) {
-    return ports;
-  } else if (retired()) {
-    return ports;
   }
-  
-  if (n_assem_order1 > 0){
-    // building request portfolio for region 1 and recording demand
-    for (int i = 0; i < n_assem_order1; i++) {
-      RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
-      std::string commod = fuel_incommods[region1_ID];
-      cyclus::Composition::Ptr recipe = context()->GetRecipe(fuel_inrecipes[region1_ID]);
-      m = Material::CreateUntracked(assem_size[region1_ID], recipe);
 
-      Request<Material>* r = port->AddRequest(m, this, commod, 1.0, true);
-      cyclus::toolkit::RecordTimeSeries<double>("demand"+fuel_incommods[region1_ID], this,
-                                            assem_size[region1_ID]) ;
+  for (int i = 0; i < n_regions(); i++) {
+    Region& r = regions_[i];
+    int n_assem_order = OrderSize(i, n_cycles_left);
+
+    // demand is written with the reactor's events in the Tock, so that
+    // requests can be collected from many reactors at once.
+    r.n_assem_requested = n_assem_order;
+
+    // building request portfolios for the region. One portfolio per assembly
+    // unless the region's requests are aggregated.
+    RequestPortfolio<Material>::Ptr port;
+    for (int j = 0; j < n_assem_order; j++) {
+      if (j == 0 || !aggregate_requests) {
+        port = RequestPortfolio<Material>::Ptr(new RequestPortfolio<Material>());
+        ports.insert(port);
+      }
+      // every request shares the region's target, which is never modified
+      Request<Material>* req = port->AddRequest(r.spec->request_target, this,
+                                                fuel_incommods[i], 1.0, true);
+      AREAL_PROFILE_COUNT(REQUESTS, 1);
+    }
 
-      ports.insert(port);
+    if (aggregate_requests && n_assem_order > 0) {
+      port->AddConstraint(r.spec->request_caps[n_assem_order - 1]);
     }
   }
 
-  if (n_assem_order2 > 0){
-    // building request portfolio for region 2 and recording demand
-    for (int i = 0; i < n_assem_order2; i++) {
-      RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
-      std::string commod = fuel_incommods[region2_ID];
-      cyclus::Composition::Ptr recipe = context()->GetRecipe(fuel_inrecipes[region2_ID]);
-      m = Material::CreateUntracked(assem_size[region2_ID], recipe);
+  return ports;
+}
 
-      Request<Material>* r = port->AddRequest(m, this, commod, 1.0, true);
-      cyclus::toolkit::RecordTimeSeries<double>("demand"+fuel_incommods[region2_ID], this,
-                                            assem_size[region2_ID]) ;
+int TwoRegionReactor::OrderSize(int region_num, double n_cycles_left) const {
+  const Region& r = regions_[region_num];
+  const RegionSpec& s = *r.spec;
+  int n_assem_order = s.n_assem_core - r.core.count() + s.n_assem_fresh -
+                      r.fresh.count();
 
-      ports.insert(port);
-    }
+  // reduce assembles to amount needed until retirement if it is near.
+  if (exit_time() != -1) {
+    int n_need = std::max(0.0, n_cycles_left * s.n_assem_batch -
+                               s.n_assem_fresh + s.n_assem_core -
+                               r.core.count());
+    n_assem_order = std::min(n_assem_order, n_need);
   }
-
-  return ports;
+  return n_assem_order;
 }
 
 void TwoRegionReactor::GetMatlTrades(
@@ -246,70 +678,71 @@ void TwoRegionReactor::GetMatlTrades(
     std::vector<std::pair<cyclus::Trade<Material>, Material::Ptr> >&
         responses) {
   using cyclus::Trade;
+  AREAL_PROFILE_PHASE(TRADES);
+  AREAL_PROFILE_COUNT(TRADES, trades.size());
+
+  // each trade is filled from the region whose assembly was bid, so that
+  // regions sharing an outcommod do not respond to the same trade twice.
+  // Trades are routed before any assembly is handed out because a bid
+  // assembly may be handed out for an earlier trade.
+  std::vector<int> trade_regions(trades.size());
+  std::vector<int> n_trades(n_regions(), 0);
+  for (int j = 0; j < trades.size(); j++) {
+    trade_regions[j] = spent_region(trades[j].bid->offer(),
+                                    trades[j].request->commodity());
+    ++n_trades[trade_regions[j]];
+  }
+  if (trace_) {
+    TraceTrades(trades, trade_regions);
+  }
 
-  for (int i = 0; i < 2; i++){
-    std::map<std::string, MatVec> mats = PopSpent(i);
-    for (int j = 0; j < trades.size(); j++) {
-      std::string commod = trades[j].request->commodity();
-      if (commod != fuel_outcommods[i]) {
-        continue;
-      }
-      Material::Ptr m = mats[commod].back();
-      mats[commod].pop_back();
-      responses.push_back(std::make_pair(trades[j], m));
-      res_indexes.erase(m->obj_id());
-    }
-    PushSpent(mats, i);  // return leftovers back to spent buffer
+  // only the oldest assemblies needed are taken, so we trade away oldest
+  // assemblies first and the rest of the spent fuel stays put
+  std::vector<MatVec> mats(n_regions());
+  for (int i = 0; i < n_regions(); i++) {
+    mats[i] = TakeSpent(n_trades[i], i);
+  }
+
+  std::vector<int> next(n_regions(), 0);
+  for (int j = 0; j < trades.size(); j++) {
+    int i = trade_regions[j];
+    responses.push_back(std::make_pair(trades[j], mats[i][next[i]++]));
   }
 }
 
 void TwoRegionReactor::AcceptMatlTrades(const std::vector<
     std::pair<cyclus::Trade<Material>, Material::Ptr> >& responses) {
   // DRE phase 5.2 -- getting materials from other facilities
+  AREAL_PROFILE_PHASE(ACCEPT);
+  AREAL_PROFILE_COUNT(ACCEPT, responses.size());
+  if (trace_) {
+    TraceAccept(responses);
+  }
   std::vector<std::pair<cyclus::Trade<Material>,
                         Material::Ptr> >::const_iterator trade;
 
-  std::stringstream ss;
-  int num_response1 = 0;
-  int num_response2 = 0; 
-  for (trade = responses.begin(); trade != responses.end(); ++trade){
-    std::string commod = trade->first.request->commodity();
-    if (commod == fuel_incommods[region1_ID]){
-      ++num_response1;
-    }
-    if (commod == fuel_incommods[region2_ID]){
-      ++num_response2;
-    }
+  std::vector<int> resp_regions;
+  std::vector<int> n_response(n_regions(), 0);
+  for (trade = responses.begin(); trade != responses.end(); ++trade) {
+    resp_regions.push_back(incommod_region(trade->first.request->commodity()));
+    ++n_response[resp_regions.back()];
   }
-  int nload1 = std::min(num_response1, n_assem_region[region1_ID] - core1.count());
-  int nload2 = std::min(num_response2, n_assem_region[region2_ID] - core2.count());
 
-  if (nload1 > 0) {
-    ss << nload1 << " assemblies in Region 1";
-    Record("LOAD", ss.str());
-  }
-  if (nload2 > 0 ) {
-    ss << nload2 << "assemblies in Region 2";
-    Record("LOAD", ss.str());
+  for (int i = 0; i < n_regions(); i++) {
+    int nload = std::min(n_response[i], regions_[i].spec->n_assem_core -
+                                            regions_[i].core.count());
+    if (nload > 0) {
+      Record("LOAD", i, nload, nload * regions_[i].spec->assem_size);
+    }
   }
 
-  for (trade = responses.begin(); trade != responses.end(); ++trade) {
-    std::string commod = trade->first.request->commodity();
-    Material::Ptr m = trade->second;
-    index_res(m, commod);
-    if (commod == fuel_incommods[region1_ID]){
-      if (core1.count() < n_assem_region[region1_ID]) {
-        core1.Push(m);
-      } else {
-        fresh1.Push(m);
-      }
-    }
-    if (commod == fuel_incommods[region2_ID]){
-      if (core2.count() < n_assem_region[region2_ID]) {
-        core2.Push(m);
-      } else {
-        fresh2.Push(m);
-      }
+  for (int j = 0; j < responses.size(); j++) {
+    Material::Ptr m = responses[j].second;
+    Region& r = regions_[resp_regions[j]];
+    if (r.core.count() < r.spec->n_assem_core) {
+      LoadCore(MatVec(1, m), resp_regions[j]);
+    } else {
+      r.fresh.Push(m);
     }
   }
 }
@@ -318,81 +751,112 @@ std::set<cyclus::BidPortfolio<Material>::Ptr> TwoRegionReactor::GetMatlBids(
     cyclus::CommodMap<Material>::type& commod_requests) {
   // DRE phase 2 -- getting bids that might fulfil other facility requests
   using cyclus::BidPortfolio;
+  AREAL_PROFILE_PHASE(BIDS);
   std::set<BidPortfolio<Material>::Ptr> ports;
-
-  bool gotmats = false;
-  std::map<std::string, MatVec> all_mats;
-
-  if (uniq_outcommods_.empty()) {
-    for (int i = 0; i < fuel_outcommods.size(); i++) {
-      uniq_outcommods_.insert(fuel_outcommods[i]);
-    }
+  if (trace_) {
+    TraceBids(commod_requests);
   }
 
-  for (int i = 0; i < 2; i++) {
-    std::string commod = fuel_outcommods[i];
-    std::vector<Request<Material>*>& reqs = commod_requests[commod];
-    all_mats = PeekSpent(i);
-    if (reqs.size() == 0) {
+  // each outcommod is looked up once and bid on by every region that
+  // offers spent fuel on it
+  for (int c = 0; c < spec_->outcommod_regions.size(); c++) {
+    const std::vector<int>& regions = spec_->outcommod_regions[c];
+    if (regions.empty()) {
       continue;
     }
-
-    MatVec mats = all_mats[commod];
-    if (mats.size() == 0) {
+    cyclus::CommodMap<Material>::type::iterator it =
+        commod_requests.find(spec_->commods[c]);
+    if (it == commod_requests.end() || it->second.size() == 0) {
       continue;
     }
+    std::vector<Request<Material>*>& reqs = it->second;
+
+    // When pruning, regions sharing an outcommod continue from the first
+    // request the previous region did not bid on.
+    int next_req = 0;
+    for (int n = 0; n < regions.size() && next_req < reqs.size(); n++) {
+      int i = regions[n];
+      const std::deque<Material::Ptr>& mats = PeekSpent(i);
+      if (mats.size() == 0) {
+        continue;
+      }
 
-    BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
+      BidPortfolio<Material>::Ptr port(new BidPortfolio<Material>());
 
-    for (int j = 0; j < reqs.size(); j++) {
-      Request<Material>* req = reqs[j];
-      double tot_bid = 0;
-      for (int k = 0; k < mats.size(); k++) {
-        Material::Ptr m = mats[k];
-        tot_bid += m->quantity();
-        port->AddBid(req, m, this, true);
-        if (tot_bid >= req->target()->quantity()) {
+      // each request is offered the oldest assemblies until it is satisfied,
+      // so that any request bid on can take the oldest fuel.  When pruning,
+      // bidding stops once as many bids as assemblies have been made.
+      int j = next_req;
+      int n_bids = 0;
+      for (; j < reqs.size(); j++) {
+        if (prune_bids && n_bids >= mats.size()) {
           break;
         }
+        Request<Material>* req = reqs[j];
+        double tot_bid = 0;
+        for (int k = 0; k < mats.size(); k++) {
+          tot_bid += mats[k]->quantity();
+          port->AddBid(req, mats[k], this, true);
+          AREAL_PROFILE_COUNT(BIDS, 1);
+          ++n_bids;
+          if (tot_bid >= req->target()->quantity()) {
+            break;
+          }
+        }
+      }
+      if (prune_bids) {
+        next_req = j;
       }
-    }
 
-    double tot_qty = 0;
-    for (int j = 0; j < mats.size(); j++) {
-      tot_qty += mats[j]->quantity();
+      // constrained to the running total of the mass in the spent buffer
+      port->AddConstraint(*regions_[i].spent_cap);
+      ports.insert(port);
     }
-
-    cyclus::CapacityConstraint<Material> cc(tot_qty);
-    port->AddConstraint(cc);
-    ports.insert(port);
   }
 
   return ports;
 }
 
 void TwoRegionReactor::Tock() {
+  AREAL_PROFILE_PHASE(TOCK);
+  if (context()->time() < quiet_until_) {
+    // mid-cycle with a full core - only power needs recording
+    cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(this, power_cap);
+    cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this, power_cap);
+    Irradiate();
+    cycle_step++;
+    FlushEvents();
+    return;
+  }
+
   if (retired()) { 
+    FlushEvents();
     return;
   }
-  
+
+  bool full_core = FullCore();
+  bool all_discharged = true;
+  for (int i = 0; i < n_regions(); i++) {
+    all_discharged = all_discharged && discharged[i];
+  }
+
   // Check that irradiation and refueling periods are over, that 
   // the core is full and that fuel was successfully discharged in this refueling time.
   // If this is the case, then a new cycle will be initiated.
-  if (ReadyToRefuel() && FullRegion(region1_ID) && FullRegion(region2_ID) && discharged1 == true && discharged2 == true) {
-    discharged1 = false;
-    discharged2 = false; 
+  if (ReadyToRefuel() && full_core && all_discharged) {
+    discharged.assign(n_regions(), 0);
     cycle_step = 0;
   }
 
-  if (cycle_step == 0 && FullRegion(region1_ID) && FullRegion(region2_ID)) {
-    Record("CYCLE_START", "");
+  if (cycle_step == 0 && full_core) {
+    Record("CYCLE_START");
   }
 
   // record power generation if we're in the middle of a cycle. 
-  if (cycle_step >= 0 && cycle_step < cycle_time &&
-      FullRegion(region1_ID) && FullRegion(region2_ID)) {
+  if (cycle_step >= 0 && cycle_step < cycle_time && full_core) {
     cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(this, power_cap);
     cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this, power_cap);
+    Irradiate();
   } else {
     cyclus::toolkit::RecordTimeSeries<cyclus::toolkit::POWER>(this, 0);
     cyclus::toolkit::RecordTimeSeries<double>("supplyPOWER", this, 0);
@@ -400,239 +864,468 @@ void TwoRegionReactor::Tock() {
 
   // "if" prevents starting cycle after initial deployment until core is full
   // even though cycle_step is its initial zero.
-  if ((cycle_step > 0) || (FullRegion(region1_ID) && FullRegion(region2_ID))){
+  if ((cycle_step > 0) || full_core){
       cycle_step++;
   }
+
+  UpdateQuietUntil(full_core);
+  FlushEvents();
+}
+
+void TwoRegionReactor::UpdateQuietUntil(bool full_core) {
+  quiet_until_ = -1;
+  if (!full_core || cycle_step <= 0 || cycle_step >= cycle_time) {
+    return;
+  }
+  for (int i = 0; i < n_regions(); i++) {
+    if (regions_[i].fresh.count() < regions_[i].spec->n_assem_fresh) {
+      return;  // still ordering fresh fuel
+    }
+  }
+
+  // the next Tick to do any work is the one that ends the cycle, which sees
+  // cycle_step == cycle_time after cycle_time - cycle_step more Tocks
+  quiet_until_ = context()->time() + cycle_time - cycle_step + 1;
+  if (exit_time() != -1) {
+    quiet_until_ = std::min(quiet_until_, exit_time() + 1);
+  }
 }
 
 void TwoRegionReactor::Transmute() { 
-  for (int i=0; i < 2; i++){
+  for (int i = 0; i < n_regions(); i++){
     // transmute in each region of the core
-    Transmute(n_assem_batch[i], i);
+    Transmute(regions_[i].spec->n_assem_batch, i);
   }
 }
 
 void TwoRegionReactor::Transmute(int n_assem, int region_num) {
-  MatVec old; 
-  
-  if (region_num == 0){
-    old = core1.PopN(std::min(n_assem, core1.count()));
-    core1.Push(old);
-    if (core1.count() > old.size()) {
-      // rotate untransmuted mats back to back of buffer
-      core1.Push(core1.PopN(core1.count() - old.size()));
+  Region& r = regions_[region_num];
+  int n = std::min<int>(n_assem, r.core_mats.size());
+
+  Record("TRANSMUTE", region_num, n, n * r.spec->assem_size);
+
+  // the oldest assemblies are at the front of the core and are the next to
+  // be discharged.  Every assembly in the core was received for this region.
+  if (!r.spec->depletion && !r.spec->library) {
+    for (int i = 0; i < n; i++) {
+      r.core_mats[i]->Transmute(r.spec->outrecipe);
     }
+    return;
   }
 
-  if (region_num == 1){
-    old = core2.PopN(std::min(n_assem, core2.count()));
-    core2.Push(old);
-    if (core2.count() > old.size()) {
-      // rotate untransmuted mats back to back of buffer
-      core2.Push(core2.PopN(core2.count() - old.size()));
-    }}
+  // assemblies loaded together share a composition and irradiation time,
+  // so each run of them is looked up once
+  cyclus::Composition::Ptr fresh;
+  cyclus::Composition::Ptr burnt;
+  int n_steps = -1;
+  for (int i = 0; i < n; i++) {
+    Material::Ptr m = r.core_mats[i];
+    int steps = burn_steps[region_num] - r.core_loaded_at[i];
+    if (m->comp() != fresh || steps != n_steps) {
+      fresh = m->comp();
+      n_steps = steps;
+      burnt = r.spec->depletion ? r.spec->depletion->Deplete(fresh, n_steps)
+                                : r.spec->library->Spent(n_steps);
+    }
+    m->Transmute(burnt);
+  }
+}
 
-  std::stringstream ss;
-  ss << old.size() << " assemblies in region " << region_num;
-  Record("TRANSMUTE", ss.str());
+void TwoRegionReactor::Irradiate() {
+  // assemblies are depleted when they are transmuted, by the number of steps
+  // counted since they were loaded, so nothing per assembly is done here.
+  // The same counts index burnup libraries.
+  for (int i = 0; i < n_regions(); i++) {
+    burn_steps[i]++;
+  }
+}
 
-  for (int i = 0; i < old.size(); i++) {
-    old[i]->Transmute(context()->GetRecipe(fuel_outrecipe(old[i])));
+bool TwoRegionReactor::Discharge(int region_num) {
+  Region& r = regions_[region_num];
+  int npop = std::min(r.spec->n_assem_batch, r.core.count());
+  if (r.spec->n_assem_spent - r.spent.count() < npop) {
+    Record("DISCHARGE_FAILED", region_num, npop, npop * r.spec->assem_size);
+    return false;  // not enough room in spent buffer
   }
+
+  Record("DISCHARGE", region_num, npop, npop * r.spec->assem_size);
+  StoreSpent(UnloadCore(npop, region_num), region_num);
+
+  // the spent buffer keeps a running total of the mass it holds, all of
+  // which is offered on the region's outcommod
+  cyclus::toolkit::RecordTimeSeries<double>(r.spec->supply_series, this,
+                                            r.spent.quantity());
+
+  return true;
 }
 
-std::map<std::string, MatVec> TwoRegionReactor::PeekSpent(int region_num) {
-  // looking at the number and commodity name of the materials in each region
-  std::map<std::string, MatVec> mapped;
-  MatVec mats; 
-  if (region_num == 0){
-    mats = spent1.PopN(spent1.count());
-    spent1.Push(mats);
+bool TwoRegionReactor::DischargeAll(int region_num) {
+  Region& r = regions_[region_num];
+  int n_core = r.core.count();
+  int n_fresh = r.fresh.count();
+  if (n_core + n_fresh == 0) {
+    return true;
   }
-  if (region_num == 1){
-    mats = spent2.PopN(spent2.count());
-    spent2.Push(mats);
+
+  // core assemblies leave in whole batches as through Discharge, unless the
+  // whole core fits.  Fresh assemblies fill whatever room is left - in case
+  // a cycle landed exactly on the last time step a batch may be waiting in
+  // fresh inventory.
+  int room = r.spec->n_assem_spent - r.spent.count();
+  int batch = std::max(1, r.spec->n_assem_batch);
+  int n_core_out = room >= n_core ? n_core : room / batch * batch;
+  int n_fresh_out = std::min(n_fresh, room - n_core_out);
+  if (n_core_out + n_fresh_out == 0) {
+    if (n_core > 0) {
+      int npop = std::min(batch, n_core);
+      Record("DISCHARGE_FAILED", region_num, npop, npop * r.spec->assem_size);
+    }
+    return false;  // not enough room in spent buffer
   }
-  for (int i = 0; i < mats.size(); i++) {
-    std::string commod = fuel_outcommod(mats[i]);
-    mapped[commod].push_back(mats[i]);
+
+  MatVec mats = UnloadCore(n_core_out, region_num);
+  MatVec fresh = r.fresh.PopN(n_fresh_out);
+  mats.insert(mats.end(), fresh.begin(), fresh.end());
+  StoreSpent(mats, region_num);
+
+  Record("DISCHARGE", region_num, mats.size(),
+         mats.size() * r.spec->assem_size);
+  cyclus::toolkit::RecordTimeSeries<double>(r.spec->supply_series, this,
+                                            r.spent.quantity());
+
+  return n_core_out == n_core && n_fresh_out == n_fresh;
+}
+
+void TwoRegionReactor::Load(int region_num) {
+  Region& r = regions_[region_num];
+  int n = std::min(r.spec->n_assem_core - r.core.count(), r.fresh.count());
+  if (n == 0) {
+    return;
   }
-  
-  return mapped;
+
+  Record("LOAD", region_num, n, n * r.spec->assem_size);
+  LoadCore(r.fresh.PopN(n), region_num);
 }
 
-bool TwoRegionReactor::Discharge(int region_num) {
-  if (region_num == 0){
-    int npop = std::min(n_assem_batch[region1_ID], core1.count());
-    if (n_assem_spent[region1_ID] - spent1.count() < npop) {
-      Record("DISCHARGE", "failed");
-      return false;  // not enough room in spent buffer
-    }
+int TwoRegionReactor::commod_id(const std::string& commod) const {
+  std::map<std::string, int>::const_iterator it =
+      spec_->commod_ids.find(commod);
+  return it == spec_->commod_ids.end() ? -1 : it->second;
+}
 
-    std::stringstream ss;
-    ss << npop << " assemblies from Region 1";
-    Record("DISCHARGE", ss.str());
-    spent1.Push(core1.PopN(npop));
+int TwoRegionReactor::Intern(Spec* spec, const std::string& commod) {
+  std::map<std::string, int>::iterator it = spec->commod_ids.find(commod);
+  if (it != spec->commod_ids.end()) {
+    return it->second;
   }
+  int c = spec->commods.size();
+  spec->commods.push_back(commod);
+  spec->commod_ids[commod] = c;
+  spec->incommod_regions.push_back(-1);
+  spec->outcommod_regions.push_back(std::vector<int>());
+  return c;
+}
 
-  if (region_num == 1){
-    int npop = std::min(n_assem_batch[region2_ID], core2.count());
-    if (n_assem_spent[region2_ID] - spent2.count() < npop) {
-      Record("DISCHARGE", "failed");
-      return false;  // not enough room in spent buffer
+void TwoRegionReactor::InternCommods(Spec* spec) const {
+  for (int i = 0; i < spec->regions.size(); i++) {
+    RegionSpec& r = spec->regions[i];
+    r.incommod = Intern(spec, fuel_incommods[i]);
+    r.outcommod = Intern(spec, fuel_outcommods[i]);
+    if (spec->incommod_regions[r.incommod] < 0) {
+      spec->incommod_regions[r.incommod] = i;
     }
+    spec->outcommod_regions[r.outcommod].push_back(i);
+    r.demand_series = "demand" + fuel_incommods[i];
+    r.supply_series = "supply" + fuel_outcommods[i];
+  }
+}
 
-    std::stringstream ss;
-    ss << npop << " assemblies from Region 2";
-    Record("DISCHARGE", ss.str());
-    spent2.Push(core2.PopN(npop));
+int TwoRegionReactor::incommod_region(const std::string& incommod) {
+  // get the first region whose fuel_incommods entry matches the commodity
+  int c = commod_id(incommod);
+  if (c < 0 || spec_->incommod_regions[c] < 0) {
+    throw ValueError(
+        "areal::TwoRegionReactor - received unsupported incommod material");
   }
+  return spec_->incommod_regions[c];
+}
 
-  std::map<std::string, MatVec> spent_mats;
-  spent_mats = PeekSpent(region_num);
-  MatVec mats = spent_mats[fuel_outcommods[region_num]];
-  double tot_spent = 0;
-  for (int i = 0; i < mats.size(); i++){
-    Material::Ptr m = mats[i];
-    tot_spent += m->quantity();
+int TwoRegionReactor::spent_region(const Material::Ptr& m,
+                                   const std::string& commod) {
+  int c = commod_id(commod);
+  if (c >= 0 && spec_->outcommod_regions[c].size() == 1) {
+    return spec_->outcommod_regions[c][0];
   }
-  cyclus::toolkit::RecordTimeSeries<double>("supply"+fuel_outcommods[region_num], this, tot_spent);
 
-  return true;
+  // regions share the outcommod, so look up the region of the assembly
+  std::unordered_map<int, int>::const_iterator it =
+      shared_spent_regions_.find(m->obj_id());
+  if (c >= 0 && it != shared_spent_regions_.end()) {
+    return it->second;
+  }
+  throw KeyError("areal::TwoRegionReactor - no spent fuel for material object");
 }
 
-void TwoRegionReactor::Load(int region_num) {
-  if (region_num == 0){
-    int n = std::min(n_assem_region[region1_ID] - core1.count(), fresh1.count());
-    if (n == 0) {
-      return;
-    }
+void TwoRegionReactor::LoadCore(const MatVec& mats, int region_num) {
+  Region& r = regions_[region_num];
+  r.core.Push(mats);
+  r.core_mats.insert(r.core_mats.end(), mats.begin(), mats.end());
+  r.core_loaded_at.insert(r.core_loaded_at.end(), mats.size(),
+                          burn_steps[region_num]);
+}
 
-    std::stringstream ss;
-    ss << n << " assemblies into Region 1";
-    Record("LOAD", ss.str());
-    core1.Push(fresh1.PopN(n));
+MatVec TwoRegionReactor::UnloadCore(int n, int region_num) {
+  Region& r = regions_[region_num];
+  r.core_mats.erase(r.core_mats.begin(), r.core_mats.begin() + n);
+  r.core_loaded_at.erase(r.core_loaded_at.begin(),
+                         r.core_loaded_at.begin() + n);
+  return r.core.PopN(n);
+}
+
+void TwoRegionReactor::StoreSpent(const MatVec& mats, int region_num) {
+  if (mats.empty()) {
+    return;
   }
-  if (region_num == 1){
-    int n = std::min(n_assem_region[region2_ID] - core2.count(), fresh2.count());
-    if (n == 0) {
-      return;
+  Region& r = regions_[region_num];
+  r.spent.Push(mats);
+  r.spent_mats.insert(r.spent_mats.end(), mats.begin(), mats.end());
+  if (spec_->outcommod_regions[r.spec->outcommod].size() > 1) {
+    for (int j = 0; j < mats.size(); j++) {
+      shared_spent_regions_[mats[j]->obj_id()] = region_num;
     }
-
-    std::stringstream ss;
-    ss << n << " assemblies into Region 2";
-    Record("LOAD", ss.str());
-    core2.Push(fresh2.PopN(n));
   }
+  UpdateSpentCap(region_num);
 }
 
-std::string TwoRegionReactor::fuel_incommod(Material::Ptr m) {
-  // get the input commodity name for a material
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_incommods.size()) {
-    throw KeyError("areal::TwoRegionReactor - no incommod for material object");
+MatVec TwoRegionReactor::TakeSpent(int n, int region_num) {
+  if (n == 0) {
+    return MatVec();
   }
-  return fuel_incommods[i];
+  // the spent buffer is first in first out, so the oldest are at its front
+  Region& r = regions_[region_num];
+  r.spent_mats.erase(r.spent_mats.begin(), r.spent_mats.begin() + n);
+  MatVec mats = r.spent.PopN(n);
+  if (spec_->outcommod_regions[r.spec->outcommod].size() > 1) {
+    for (int j = 0; j < mats.size(); j++) {
+      shared_spent_regions_.erase(mats[j]->obj_id());
+    }
+  }
+  UpdateSpentCap(region_num);
+  return mats;
 }
 
-std::string TwoRegionReactor::fuel_outcommod(Material::Ptr m) {
-  // get the output commodity name for a material
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_outcommods.size()) {
-    throw KeyError("areal::TwoRegionReactor - no outcommod for material object");
+void TwoRegionReactor::UpdateSpentCap(int region_num) {
+  Region& r = regions_[region_num];
+  if (r.spent.count() == 0) {
+    r.spent_cap.reset();
+    return;
   }
-  return fuel_outcommods[i];
+  r.spent_cap.reset(
+      new cyclus::CapacityConstraint<Material>(r.spent.quantity()));
 }
 
-std::string TwoRegionReactor::fuel_inrecipe(Material::Ptr m) {
-  // get the input recipe name for a material
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_inrecipes.size()) {
-    throw KeyError("areal::TwoRegionReactor - no inrecipe for material object");
-  }
-  return fuel_inrecipes[i];
+bool TwoRegionReactor::ReadyToRefuel() {
+  return cycle_step >= cycle_time + refuel_time;
 }
 
-std::string TwoRegionReactor::fuel_outrecipe(Material::Ptr m) {
-  // get the output recipe name for a material
-  int i = res_indexes[m->obj_id()];
-  if (i >= fuel_outrecipes.size()) {
-    throw KeyError("areal::TwoRegionReactor - no outrecipe for material object");
-  }
-  return fuel_outrecipes[i];
+bool TwoRegionReactor::FullRegion(int region_num) {
+  const Region& r = regions_[region_num];
+  return r.core.count() == r.spec->n_assem_core;
 }
 
-void TwoRegionReactor::index_res(cyclus::Resource::Ptr m, std::string incommod) {
-  // get the index number of the fuel_incommods input that corresponds 
-  // to a material
-  for (int i = 0; i < fuel_incommods.size(); i++) {
-    if (fuel_incommods[i] == incommod) {
-      res_indexes[m->obj_id()] = i;
-      return;
+bool TwoRegionReactor::FullCore() {
+  for (int i = 0; i < n_regions(); i++) {
+    if (!FullRegion(i)) {
+      return false;
     }
   }
-  throw ValueError(
-      "areal::TwoRegionReactor - received unsupported incommod material");
+  return true;
+}
+
+void TwoRegionReactor::Record(std::string name, int region, int n_assem,
+                              double mass) {
+  Event e = {name, region, n_assem, mass};
+  events_.push_back(e);
 }
 
-std::map<std::string, MatVec> TwoRegionReactor::PopSpent(int region_num) {
-  std::map<std::string, MatVec> mapped;
-  MatVec mats; 
-  if (region_num == 0){
-    mats = spent1.PopN(spent1.count());
+void TwoRegionReactor::FlushEvents() {
+  for (int i = 0; i < events_.size(); i++) {
+    const Event& e = events_[i];
+    context()
+        ->NewDatum("TwoRegionReactorEvents")
+        ->AddVal("AgentId", id())
+        ->AddVal("Time", context()->time())
+        ->AddVal("Event", e.name)
+        ->AddVal("Region", e.region)
+        ->AddVal("NAssem", e.n_assem)
+        ->AddVal("Mass", e.mass)
+        ->Record();
   }
-  if (region_num == 1){
-    mats = spent2.PopN(spent2.count());
+  events_.clear();
+
+  // demand from this time step's requests, either the region's total or one
+  // record per requested assembly
+  for (int i = 0; i < n_regions(); i++) {
+    Region& r = regions_[i];
+    if (r.n_assem_requested > 0 && demand_per_assembly) {
+      for (int j = 0; j < r.n_assem_requested; j++) {
+        cyclus::toolkit::RecordTimeSeries<double>(r.spec->demand_series, this,
+                                                  r.spec->assem_size);
+      }
+    } else if (r.n_assem_requested > 0) {
+      cyclus::toolkit::RecordTimeSeries<double>(
+          r.spec->demand_series, this,
+          r.n_assem_requested * r.spec->assem_size);
+    }
+    r.n_assem_requested = 0;
   }
-  for (int i = 0; i < mats.size(); i++) {
-    std::string commod = fuel_outcommod(mats[i]);
-    mapped[commod].push_back(mats[i]);
+
+  if (trace_) {
+    trace_->Flush();
   }
+}
 
-  // needed so we trade away oldest assemblies first
-  std::map<std::string, MatVec>::iterator it;
-  for (it = mapped.begin(); it != mapped.end(); ++it) {
-    std::reverse(it->second.begin(), it->second.end());
+// Writes a config element holding a list, if it has any entries.
+template <class T>
+static void ConfigList(std::stringstream& ss, const std::string& name,
+                       const std::vector<T>& v) {
+  if (v.empty()) {
+    return;
+  }
+  ss << "<" << name << ">";
+  for (int i = 0; i < v.size(); i++) {
+    ss << "<val>" << v[i] << "</val>";
   }
+  ss << "</" << name << ">";
+}
 
-  return mapped;
+std::string TwoRegionReactor::TraceConfig() const {
+  std::stringstream ss;
+  ss << std::setprecision(17);
+  ConfigList(ss, "fuel_incommods", fuel_incommods);
+  ConfigList(ss, "fuel_inrecipes", fuel_inrecipes);
+  ConfigList(ss, "fuel_outcommods", fuel_outcommods);
+  ConfigList(ss, "fuel_outrecipes", fuel_outrecipes);
+  ConfigList(ss, "assem_size", assem_size);
+  ConfigList(ss, "n_assem_batch", n_assem_batch);
+  ConfigList(ss, "n_assem_region", n_assem_region);
+  ConfigList(ss, "n_assem_fresh", n_assem_fresh);
+  ConfigList(ss, "n_assem_spent", n_assem_spent);
+  ss << "<cycle_time>" << cycle_time << "</cycle_time>"
+     << "<refuel_time>" << refuel_time << "</refuel_time>"
+     << "<cycle_step>" << cycle_step << "</cycle_step>"
+     << "<power_cap>" << power_cap << "</power_cap>"
+     << "<power_name>" << power_name << "</power_name>"
+     << "<decom_transmute_all>" << decom_transmute_all
+     << "</decom_transmute_all>"
+     << "<keep_packaging>" << keep_packaging << "</keep_packaging>"
+     << "<aggregate_requests>" << aggregate_requests << "</aggregate_requests>"
+     << "<prune_bids>" << prune_bids << "</prune_bids>"
+     << "<demand_per_assembly>" << demand_per_assembly
+     << "</demand_per_assembly>";
+  ConfigList(ss, "depletion_files", depletion_files);
+  ConfigList(ss, "burnup_libraries", burnup_libraries);
+  return ss.str();
 }
 
-void TwoRegionReactor::PushSpent(std::map<std::string, MatVec> leftover, int region_num) {
-  std::map<std::string, MatVec>::iterator it;
-  for (it = leftover.begin(); it != leftover.end(); ++it) {
-    // undo reverse in PopSpent to make sure oldest assemblies come out first
-    std::reverse(it->second.begin(), it->second.end());
-    if (region_num == 0){
-      spent1.Push(it->second);
+void TwoRegionReactor::OpenTrace() {
+  std::stringstream path;
+  path << dre_trace << "_" << id() << ".trace";
+  trace_.reset(new TraceWriter(path.str()));
+
+  TraceHeader h;
+  h.config = TraceConfig();
+  h.duration = context()->sim_info().duration - enter_time();
+  h.lifetime = lifetime();
+  for (int i = 0; i < n_regions(); i++) {
+    h.recipes[fuel_inrecipes[i]] = regions_[i].spec->inrecipe->mass();
+    h.recipes[fuel_outrecipes[i]] = regions_[i].spec->outrecipe->mass();
+  }
+  h.Write(trace_.get());
+}
+
+void TwoRegionReactor::TraceBids(
+    const cyclus::CommodMap<Material>::type& reqs) {
+  // only requests on our outcommods can be bid on
+  std::vector<cyclus::CommodMap<Material>::type::const_iterator> ours;
+  for (int c = 0; c < spec_->outcommod_regions.size(); c++) {
+    if (spec_->outcommod_regions[c].empty()) {
+      continue;
     }
-    if (region_num == 1){
-      spent2.Push(it->second);
+    cyclus::CommodMap<Material>::type::const_iterator it =
+        reqs.find(spec_->commods[c]);
+    if (it != reqs.end() && it->second.size() > 0) {
+      ours.push_back(it);
+    }
+  }
+  if (ours.empty()) {
+    return;
+  }
+
+  trace_->Record(TRACE_BIDS, trace_time());
+  trace_->Int(ours.size());
+  for (int n = 0; n < ours.size(); n++) {
+    trace_->String(ours[n]->first);
+    trace_->Int(ours[n]->second.size());
+    for (int j = 0; j < ours[n]->second.size(); j++) {
+      trace_->Double(ours[n]->second[j]->target()->quantity());
     }
   }
 }
 
-bool TwoRegionReactor::ReadyToRefuel() {
-  return cycle_step >= cycle_time + refuel_time;
+void TwoRegionReactor::TraceTrades(
+    const std::vector<cyclus::Trade<Material> >& trades,
+    const std::vector<int>& trade_regions) {
+  trace_->Record(TRACE_TRADES, trace_time());
+  trace_->Int(trades.size());
+  for (int j = 0; j < trades.size(); j++) {
+    const std::deque<Material::Ptr>& mats =
+        regions_[trade_regions[j]].spent_mats;
+    int pos = std::find(mats.begin(), mats.end(), trades[j].bid->offer()) -
+              mats.begin();
+    trace_->String(trades[j].request->commodity());
+    trace_->Int(trade_regions[j]);
+    trace_->Int(pos < mats.size() ? pos : 0);
+    trace_->Double(trades[j].amt);
+  }
 }
 
-bool TwoRegionReactor::FullRegion(int region_num) {
-  if (region_num == 0){
-    return core1.count() == n_assem_region[region1_ID];
+void TwoRegionReactor::TraceAccept(const std::vector<
+    std::pair<cyclus::Trade<Material>, Material::Ptr> >& responses) {
+  // compositions are written ahead of the record that uses them
+  std::vector<int> comps(responses.size());
+  for (int j = 0; j < responses.size(); j++) {
+    comps[j] = trace_->CompIndex(responses[j].second->comp());
   }
-  if (region_num == 1){
-    return core2.count() == n_assem_region[region2_ID];
+
+  trace_->Record(TRACE_ACCEPT, trace_time());
+  trace_->Int(responses.size());
+  for (int j = 0; j < responses.size(); j++) {
+    trace_->String(responses[j].first.request->commodity());
+    trace_->Int(comps[j]);
+    trace_->Double(responses[j].second->quantity());
   }
 }
 
-void TwoRegionReactor::Record(std::string name, std::string val) {
-  context()
-      ->NewDatum("TwoRegionReactorEvents")
-      ->AddVal("AgentId", id())
-      ->AddVal("Time", context()->time())
-      ->AddVal("Event", name)
-      ->AddVal("Value", val)
-      ->Record();
+void TwoRegionReactor::RecordProfile() {
+  if (!profile_ || profile_->recorded) {
+    return;
+  }
+  profile_->recorded = true;
+
+  static const char* names[N_PHASES] = {"Tick", "Tock", "GetMatlRequests",
+                                        "GetMatlBids", "GetMatlTrades",
+                                        "AcceptMatlTrades"};
+  for (int i = 0; i < N_PHASES; i++) {
+    context()
+        ->NewDatum("TwoRegionReactorProfile")
+        ->AddVal("AgentId", id())
+        ->AddVal("Phase", std::string(names[i]))
+        ->AddVal("Calls", profile_->calls[i])
+        ->AddVal("Seconds", profile_->seconds[i])
+        ->AddVal("Items", profile_->items[i])
+        ->Record();
+  }
 }
 
 extern "C" cyclus::Agent* ConstructTwoRegionReactor(cyclus::Context* ctx) {
@@ -1,11 +1,94 @@
 #ifndef AREAL_SRC_TWOREGIONREACTOR_H_
 #define AREAL_SRC_TWOREGIONREACTOR_H_
 
+#include <deque>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
 #include "cyclus.h"
 #include "areal_version.h"
+#include "dre_trace.h"
 
 namespace areal {
 
+/// A precomputed nuclide transmutation matrix giving the change in a core
+/// region's fuel over one time step of irradiation.  Each entry moves a
+/// fraction of a source nuclide's mass to a product nuclide (the source
+/// itself for the fraction retained); nuclides without entries are carried
+/// over unchanged.  Entries are stored by source nuclide so that a step is a
+/// sparse matrix-vector product over the nuclides present in the fuel.  The
+/// fractions of each source nuclide must sum to one, so a step conserves
+/// mass.
+///
+/// A matrix is read once per file and simulation and shared by every reactor
+/// of the simulation that names it.  Every assembly of a batch has the same
+/// composition, so the composition reached by one step from each composition
+/// is cached and computed once for the whole fleet rather than once per
+/// assembly.
+class DepletionMatrix {
+ public:
+  typedef boost::shared_ptr<DepletionMatrix> Ptr;
+
+  /// Returns the matrix in the named file, reading it the first time it is
+  /// named in ctx's simulation.
+  static Ptr Load(cyclus::Context* ctx, const std::string& path);
+
+  /// Returns the composition of fuel of composition c after n_steps time
+  /// steps of irradiation.  Safe to call from several reactors at once.
+  cyclus::Composition::Ptr Deplete(cyclus::Composition::Ptr c, int n_steps);
+
+ private:
+  /// Reads and checks the matrix in the named file.
+  static Ptr Read(const std::string& path);
+
+  /// Applies one step of the matrix to c.
+  cyclus::Composition::Ptr Step(cyclus::Composition::Ptr c) const;
+
+  /// Most compositions kept in next_ before it is emptied.
+  static const int kMaxCached = 10000;
+
+  // (product nuclide, fraction) entries of each source nuclide
+  std::map<int, std::vector<std::pair<int, double> > > entries_;
+
+  // composition one step on from each composition depleted so far, by id,
+  // guarded by mu_
+  std::map<int, cyclus::Composition::Ptr> next_;
+  std::mutex mu_;
+};
+
+/// A library of spent fuel compositions indexed by burnup, measured in time
+/// steps of irradiation.  Fuel irradiated for a number of steps between two
+/// entries gets the mass-weighted linear interpolation of their
+/// compositions, and fuel irradiated for fewer or more steps than the library
+/// covers gets its first or last entry.
+///
+/// A library is read once per file and simulation and shared read-only by
+/// every reactor of the simulation that names it.  The composition for every
+/// burnup from its first to its last entry is built when it is read.
+class BurnupLibrary {
+ public:
+  typedef boost::shared_ptr<BurnupLibrary> Ptr;
+
+  /// Returns the library in the named file, reading it the first time it is
+  /// named in ctx's simulation.
+  static Ptr Load(cyclus::Context* ctx, const std::string& path);
+
+  /// Returns the spent fuel composition after n_steps time steps of
+  /// irradiation.
+  cyclus::Composition::Ptr Spent(int n_steps) const;
+
+ private:
+  /// Reads the library in the named file and builds its compositions.
+  static Ptr Read(const std::string& path);
+
+  // burnup of the first entry, in time steps
+  int first_;
+
+  // composition of each burnup from the first entry's on
+  std::vector<cyclus::Composition::Ptr> spent_;
+};
+
 /// Reactor is a simple, general reactor based on static compositional
 /// transformations to model fuel burnup.  The user specifies a set of input
 /// fuels and corresponding burnt compositions that fuel is transformed to when
@@ -14,6 +97,14 @@ namespace areal {
 /// the core is instantaneously transmuted from its original fresh fuel
 /// composition into its spent fuel form.
 ///
+/// Optionally, a region can instead deplete its fuel incrementally with a
+/// precomputed per time step transmutation matrix (see depletion_files).
+/// Its discharged assemblies are then advanced from their fresh composition
+/// by one matrix step for every time step they spent in an operating core.
+/// A region can also take its spent compositions from a burnup-indexed
+/// library (see burnup_libraries) according to how long each assembly was
+/// irradiated.
+///
 /// Each fuel is identified by a specific input commodity and has an associated
 /// input recipe (nuclide composition), output recipe, output commidity, and
 /// preference.  The preference identifies which input fuels are preferred when
@@ -22,6 +113,11 @@ namespace areal {
 /// compositions can also be specified as a function of time using the
 /// recipe_change variables.
 ///
+/// The core is divided into one or more regions (e.g. driver, blanket and
+/// reflector zones).  Each region has its own fuel commodities, recipes,
+/// assembly size, batch size and fresh, core and spent fuel inventories.  All
+/// of the per-region input lists must have exactly one entry per region.
+///
 /// The reactor treats fuel as individual assemblies that are never split,
 /// combined or otherwise treated in any non-discrete way.  Fuel is requested
 /// in full-or-nothing assembly sized quanta.  If real-world assembly modeling
@@ -66,6 +162,14 @@ class TwoRegionReactor : public cyclus::Facility,
   " the core is instantaneously transmuted from its original fresh fuel" \
   " composition into its spent fuel form." \
   "\n\n" \
+  "Optionally, a region can instead deplete its fuel incrementally with a" \
+  " precomputed per time step transmutation matrix (see depletion_files)." \
+  " Its discharged assemblies are then advanced from their fresh composition" \
+  " by one matrix step for every time step they spent in an operating core." \
+  " A region can also take its spent compositions from a burnup-indexed" \
+  " library (see burnup_libraries) according to how long each assembly was" \
+  " irradiated." \
+  "\n\n" \
   "Each fuel is identified by a specific input commodity and has an associated" \
   " input recipe (nuclide composition), output recipe, output commidity, and" \
   " preference.  The preference identifies which input fuels are preferred when" \
@@ -74,6 +178,11 @@ class TwoRegionReactor : public cyclus::Facility,
   " compositions can also be specified as a function of time using the" \
   " recipe_change variables." \
   "\n\n" \
+  "The core is divided into one or more regions (e.g. driver, blanket and" \
+  " reflector zones).  Each region has its own fuel commodities, recipes," \
+  " assembly size, batch size and fresh, core and spent fuel inventories.  All" \
+  " of the per-region input lists must have exactly one entry per region." \
+  "\n\n" \
   "The reactor treats fuel as individual assemblies that are never split," \
   " combined or otherwise treated in any non-discrete way.  Fuel is requested" \
   " in full-or-nothing assembly sized quanta.  If real-world assembly modeling" \
@@ -115,11 +224,19 @@ class TwoRegionReactor : public cyclus::Facility,
   virtual void Tick();
   virtual void Tock();
   virtual void EnterNotify();
+  virtual void Decommission();
   virtual bool CheckDecommissionCondition();
 
   virtual void AcceptMatlTrades(const std::vector<std::pair<
       cyclus::Trade<cyclus::Material>, cyclus::Material::Ptr> >& responses);
 
+  /// GetMatlRequests and GetMatlBids only read the reactor's state, apart
+  /// from noting the demand to record in the Tock and writing the reactor's
+  /// own DRE trace, so they may be called concurrently for different
+  /// reactors.  They create no materials or capacity constraints, both of
+  /// which take an id from a process-wide counter - the constraints they
+  /// attach are built beforehand (see RegionSpec::request_caps and
+  /// Region::spent_cap).
   virtual std::set<cyclus::RequestPortfolio<cyclus::Material>::Ptr>
   GetMatlRequests();
 
@@ -137,28 +254,186 @@ class TwoRegionReactor : public cyclus::Facility,
   // Code Injection:
   #include "toolkit/position.cycpp.h"
 
-  std::string fuel_incommod(cyclus::Material::Ptr m);
-  std::string fuel_outcommod(cyclus::Material::Ptr m);
-  std::string fuel_inrecipe(cyclus::Material::Ptr m);
-  std::string fuel_outrecipe(cyclus::Material::Ptr m);
-
-  // vector index for each region. Want to variables 
-  // to prevent confusing with the 0-indexing for 
-  // the vectors
-  int region1_ID = 0;
-  int region2_ID = 1;
-
-  bool retired() {
+  /// Fuel compositions, commodities and core parameters of one region,
+  /// derived from the per-region input vectors.  Never modified once built.
+  struct RegionSpec {
+    RegionSpec()
+        : assem_size(0),
+          n_assem_batch(0),
+          n_assem_core(0),
+          n_assem_fresh(0),
+          n_assem_spent(0),
+          incommod(-1),
+          outcommod(-1) {}
+
+    /// Transmutation matrix from depletion_files and spent composition
+    /// library from burnup_libraries.  If neither is set discharged fuel is
+    /// transmuted to outrecipe.
+    DepletionMatrix::Ptr depletion;
+    BurnupLibrary::Ptr library;
+
+    /// Fresh and spent fuel compositions resolved from fuel_inrecipes and
+    /// fuel_outrecipes so that ordering and transmutation never have to look
+    /// recipes up by name.
+    cyclus::Composition::Ptr inrecipe;
+    cyclus::Composition::Ptr outrecipe;
+
+    /// Interned ids of the region's fuel_incommods and fuel_outcommods
+    /// entries, and the names of its demand and supply time series.
+    int incommod;
+    int outcommod;
+    std::string demand_series;
+    std::string supply_series;
+
+    /// Target material of every request for the region's fresh fuel, built
+    /// once when the recipes are resolved and reused by every request of
+    /// every clone.  Changing a region's recipes needs a new spec, which
+    /// builds a new target.
+    cyclus::Material::Ptr request_target;
+
+    /// Capacity constraint of an aggregated request portfolio for n
+    /// assemblies at index n - 1, for every order size the region can place.
+    std::vector<cyclus::CapacityConstraint<cyclus::Material> > request_caps;
+
+    double assem_size;
+    int n_assem_batch;
+    int n_assem_core;
+    int n_assem_fresh;
+    int n_assem_spent;
+  };
+
+  /// Everything derived from the reactor's input that does not change while
+  /// it runs.  Clones of a prototype share the prototype's spec, so a fleet
+  /// of identical reactors holds one copy of it.
+  struct Spec {
+    std::vector<RegionSpec> regions;
+
+    /// commodity names interned by InternCommods, indexed by commodity id.
+    std::vector<std::string> commods;
+    std::map<std::string, int> commod_ids;
+
+    /// first region requesting each commodity (-1 if none) and the regions
+    /// offering spent fuel on it, indexed by commodity id.
+    std::vector<int> incommod_regions;
+    std::vector<std::vector<int> > outcommod_regions;
+  };
+
+  /// Per-region inventories and the region's spec.  All regions are stored
+  /// in one contiguous array indexed by region number so that every phase of
+  /// the reactor is a single loop over regions.
+  struct Region {
+    Region() : spec(NULL), n_assem_requested(0) {}
+
+    /// The region's entry in the reactor's spec.
+    const RegionSpec* spec;
+
+    cyclus::toolkit::ResBuf<cyclus::Material> fresh;
+    cyclus::toolkit::ResBuf<cyclus::Material> core;
+    cyclus::toolkit::ResBuf<cyclus::Material> spent;
+
+    /// Spent assemblies in the order they entered the spent buffer (oldest
+    /// first), kept in step with the buffer so it can be inspected without
+    /// popping it.  Everything in a region's spent buffer is offered on the
+    /// region's outcommod, so this is also its per-outcommod grouping, and
+    /// spent.quantity() is the running mass total for that outcommod.
+    std::deque<cyclus::Material::Ptr> spent_mats;
+
+    /// Capacity constraint of the region's spent fuel bids, rebuilt with the
+    /// running mass total whenever the spent buffer changes.  Constraints
+    /// must have a positive capacity, so it is null while the buffer is
+    /// empty.
+    boost::shared_ptr<cyclus::CapacityConstraint<cyclus::Material> > spent_cap;
+
+    /// Core assemblies in the order they were loaded, kept in step with the
+    /// core buffer.  The oldest batch is always at the front, so the batch
+    /// transmuted and discharged at the end of a cycle is reached without
+    /// touching the rest of the core.
+    std::deque<cyclus::Material::Ptr> core_mats;
+
+    /// The region's burn_steps count when each core assembly was loaded, in
+    /// step with core_mats.  Only used when the region has a depletion
+    /// matrix or burnup library.
+    std::deque<int> core_loaded_at;
+
+    /// Assemblies requested this time step, recorded as demand in the Tock.
+    int n_assem_requested;
+  };
+
+  /// A reactor event waiting to be written to the output db.
+  struct Event {
+    std::string name;
+    int region;
+    int n_assem;
+    double mass;
+  };
+
+  /// Per-phase timing and counting of the reactor's hot paths, defined in
+  /// tworegionreactor.cc and kept only when built with AREAL_PROFILE
+  /// (cmake -DUSE_PROFILING=ON).
+  struct Profile;
+  class PhaseTimer;
+
+  /// Writes the profile, if there is one, to the TwoRegionReactorProfile
+  /// table, once.
+  void RecordProfile();
+
+  bool retired() const {
     return exit_time() != -1 && context()->time() > exit_time();
   }
 
-  /// Store fuel info index for the given resource received on incommod.
-  void index_res(cyclus::Resource::Ptr m, std::string incommod);
+  /// Validates the per-region input vectors and builds the region array from
+  /// them, and the spec if this reactor does not share one.  Safe to call
+  /// more than once - inventories that already exist are kept.
+  void InitRegions();
+
+  /// Fills in defaults for the optional per-region input vectors and throws
+  /// if any of them does not have one entry per region.
+  void CheckRegionVars();
+
+  /// Builds a spec from the per-region input vectors, which must have been
+  /// checked.
+  boost::shared_ptr<const Spec> BuildSpec() const;
+
+  /// Resolves the fresh and spent fuel compositions of every region of a
+  /// spec from the context.
+  void ResolveRecipes(Spec* spec) const;
+
+  /// Returns the number of assemblies a region should order this time step.
+  int OrderSize(int region_num, double n_cycles_left) const;
+
+  /// Returns the number of core regions in this reactor.
+  int n_regions() const { return regions_.size(); }
+
+  /// Interns every region's commodities and builds the commodity to region
+  /// lookups of a spec.  Commodities are only handled as strings at the DRE
+  /// boundary.
+  void InternCommods(Spec* spec) const;
+
+  /// Returns the id of a commodity in a spec, adding it if it is new.
+  static int Intern(Spec* spec, const std::string& commod);
+
+  /// Returns the id of a commodity or -1 if it is not one of ours.
+  int commod_id(const std::string& commod) const;
+
+  /// Returns the region that requests fuel on the given incommod.  Fuel is
+  /// tagged with its region by the inventory that holds it, so no per
+  /// assembly index is kept.
+  int incommod_region(const std::string& incommod);
+
+  /// Returns the region whose spent fuel inventory holds the given assembly
+  /// that was offered on commod.
+  int spent_region(const cyclus::Material::Ptr& m, const std::string& commod);
 
   /// Discharge a batch from the core if there is room in the spent fuel
   /// inventory.  Returns true if a batch was successfully discharged.
   bool Discharge(int region_num);
 
+  /// Moves as much of a region's core and fresh fuel into spent fuel as the
+  /// spent inventory has room for, with a single capacity check, event and
+  /// supply record.  Used when retired.  Returns true if the region's core
+  /// and fresh inventory are now empty.
+  bool DischargeAll(int region_num);
+
   /// Top up core inventory as much as possible.
   void Load(int region_num);
 
@@ -167,23 +442,47 @@ class TwoRegionReactor : public cyclus::Facility,
   void Transmute();
 
   /// Transmute the specified number of assemblies in the core to their
-  /// fully burnt state as defined by their outrecipe.
+  /// fully burnt state as defined by their outrecipe, or by their region's
+  /// depletion matrix or burnup library.
   void Transmute(int n_assem, int region_num);
 
-  /// Records a reactor event to the output db with the given name and note val.
-  void Record(std::string name, std::string val);
+  /// Counts a time step of irradiation for every region.
+  void Irradiate();
+
+  /// Buffers a reactor event with the given name to be written to the output
+  /// db at the end of the time step.  Region-wide events give the region
+  /// index and the number and mass of assemblies involved; reactor-wide
+  /// events leave region as -1.
+  void Record(std::string name, int region = -1, int n_assem = 0,
+              double mass = 0);
+
+  /// Writes all buffered events to the TwoRegionReactorEvents table and the
+  /// demand of this time step's requests to each region's demand series.
+  void FlushEvents();
+
+  /// Pushes assemblies onto the back of a region's core and its ordered
+  /// view.  All additions to the core must go through here.
+  void LoadCore(const cyclus::toolkit::MatVec& mats, int region_num);
 
-  /// Complement of PopSpent - must be called with all materials passed that
-  /// were not traded away to other agents.
-  void PushSpent(std::map<std::string, cyclus::toolkit::MatVec> leftover, int region_num);
+  /// Removes the n oldest assemblies from a region's core.
+  cyclus::toolkit::MatVec UnloadCore(int n, int region_num);
 
-  /// Returns all spent assemblies indexed by outcommod - removing them from
-  /// the spent fuel buffer.
-  std::map<std::string, cyclus::toolkit::MatVec> PopSpent(int region_num);
+  /// Pushes assemblies onto the back of a region's spent fuel buffer and
+  /// its indexed view.  All additions to spent fuel must go through here.
+  void StoreSpent(const cyclus::toolkit::MatVec& mats, int region_num);
 
-  /// Returns all spent assemblies indexed by outcommod without removing them
-  /// from the spent fuel buffer.
-  std::map<std::string, cyclus::toolkit::MatVec> PeekSpent(int region_num);
+  /// Removes and returns the n oldest spent assemblies of a region, oldest
+  /// first.  The rest of the spent fuel buffer is not touched.
+  cyclus::toolkit::MatVec TakeSpent(int n, int region_num);
+
+  /// Rebuilds a region's spent fuel bid constraint from its spent mass.
+  void UpdateSpentCap(int region_num);
+
+  /// Returns all spent assemblies of a region, oldest first, without
+  /// removing them from the spent fuel buffer.
+  const std::deque<cyclus::Material::Ptr>& PeekSpent(int region_num) const {
+    return regions_[region_num].spent_mats;
+  }
 
   // check if the cycle step has reached a time 
   // to refuel the core
@@ -192,6 +491,31 @@ class TwoRegionReactor : public cyclus::Facility,
   // check if a region is full
   bool FullRegion(int region_num);
 
+  // check if every region of the core is full
+  bool FullCore();
+
+  /// Opens the reactor's DRE trace and writes its header.
+  void OpenTrace();
+
+  /// Returns the reactor's input as the body of a TwoRegionReactor config
+  /// element, for replaying its trace.
+  std::string TraceConfig() const;
+
+  /// Returns the current time step relative to the reactor's entry.
+  int trace_time() const { return context()->time() - enter_time(); }
+
+  /// Write the inputs of the DRE callbacks to the trace.
+  void TraceBids(const cyclus::CommodMap<cyclus::Material>::type& reqs);
+  void TraceTrades(const std::vector<cyclus::Trade<cyclus::Material> >& trades,
+                   const std::vector<int>& trade_regions);
+  void TraceAccept(const std::vector<std::pair<
+      cyclus::Trade<cyclus::Material>, cyclus::Material::Ptr> >& responses);
+
+  /// Computes the time until which the reactor is mid-cycle with a full core
+  /// and a full fresh fuel inventory.  Until then nothing is ordered, loaded
+  /// or discharged and each time step only records power.
+  void UpdateQuietUntil(bool full_core);
+
   /////// fuel specifications /////////
   #pragma cyclus var { \
     "uitype": ["oneormore", "incommodity"], \
@@ -232,7 +556,7 @@ class TwoRegionReactor : public cyclus::Facility,
 
  //////////// inventory and core params ////////////
   #pragma cyclus var { \
-    "doc": "Mass (kg) of a single assembly.", \
+    "doc": "Mass (kg) of a single assembly in each region.", \
     "uilabel": "Assembly Mass", \
     "uitype": "range", \
     "range": [1.0, 1e5], \
@@ -243,7 +567,7 @@ class TwoRegionReactor : public cyclus::Facility,
   #pragma cyclus var { \
     "uilabel": "Number of Assemblies per Batch in each region", \
     "doc": "Number of assemblies that constitute a single batch in each region.  " \
-           "The first entry is for region 1, the second is for region 2. " \
+           "One entry per region, in the same order as fuel_incommods. " \
            "This is the number of assemblies discharged from the core fully " \
            "burned each cycle."           \
            "Batch size is equivalent to ``n_assem_batch / n_assem_core``.", \
@@ -253,28 +577,28 @@ class TwoRegionReactor : public cyclus::Facility,
   #pragma cyclus var { \
     "uilabel": "Number of Assemblies in each region", \
     "doc": "Number of assemblies that constitute a full region. "\
-           "The first entry is for region 1 and he second is for region 2.", \
+           "One entry per region, in the same order as fuel_incommods.", \
   }
   std::vector<int> n_assem_region;
 
   #pragma cyclus var { \
-    "default": [0,0], \
+    "default": [], \
     "uilabel": "Minimum Fresh Fuel Inventory for each region",\
     "units": "assemblies", \
     "doc": "Number of fresh fuel assemblies to keep on-hand if possible. "\
-           "The first entry is for region 1 and he second is for region 2. "\
-           "The default values are 0 for each region.", \
+           "One entry per region, in the same order as fuel_incommods. "\
+           "If omitted, the value is 0 for each region.", \
   }
   std::vector<int> n_assem_fresh;
 
   #pragma cyclus var { \
-    "default": [1000000000, 1000000000], \
+    "default": [], \
     "uilabel": "Maximum Spent Fuel Inventory for each region",\
     "units": "assemblies", \
     "doc": "Number of spent fuel assemblies that can be stored on-site before" \
            " reactor operation stalls. " \
-           "The first entry is for region 1 and he second is for region 2. "\
-           "The default value for both regions is 1000000000.", \
+           "One entry per region, in the same order as fuel_incommods. "\
+           "If omitted, the value is 1000000000 for each region.", \
   }
   std::vector<int> n_assem_spent;
 
@@ -347,43 +671,142 @@ class TwoRegionReactor : public cyclus::Facility,
     "uitype": "bool"}
   bool keep_packaging;
 
-  // Resource inventories - these must be defined AFTER/BELOW the member vars
-  // referenced (e.g. n_batch_fresh, assem_size, etc.).
-  #pragma cyclus var {"capacity": "n_assem_fresh[0] * assem_size[0]"}
-  cyclus::toolkit::ResBuf<cyclus::Material> fresh1;
-  #pragma cyclus var {"capacity": "n_assem_region[0] * assem_size[0]"}
-  cyclus::toolkit::ResBuf<cyclus::Material> core1;
-  #pragma cyclus var {"capacity": "n_assem_spent[0] * assem_size[0]"}
-  cyclus::toolkit::ResBuf<cyclus::Material> spent1;
-  #pragma cyclus var {"capacity": "n_assem_fresh[1] * assem_size[1]"}
-  cyclus::toolkit::ResBuf<cyclus::Material> fresh2;
-  #pragma cyclus var {"capacity": "n_assem_region[1] * assem_size[1]"}
-  cyclus::toolkit::ResBuf<cyclus::Material> core2;
-  #pragma cyclus var {"capacity": "n_assem_spent[1] * assem_size[1]"}
-  cyclus::toolkit::ResBuf<cyclus::Material> spent2;
-
-
-  // should be hidden in ui (internal only). True if fuel has already been
-  // discharged this cycle.
-  #pragma cyclus var {"default": 0, "doc": "This should NEVER be set manually",\
+  /////////// Resource exchange behavior ///////////
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to place one request portfolio per region", \
+    "doc": "If true, each region places a single request portfolio holding " \
+           "all of the assemblies it needs on a time step, constrained to " \
+           "their total mass. If false, a separate portfolio is placed for " \
+           "every assembly. Aggregating requests greatly reduces the size " \
+           "of the exchange graph for large cores and fleets without " \
+           "changing which assemblies are traded.", \
+    "uilabel": "Aggregate Fuel Requests", \
+    "uitype": "bool"}
+  bool aggregate_requests;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to cap spent fuel bids at the spent inventory size", \
+    "doc": "Every request bid on is offered the oldest spent fuel " \
+           "assemblies that could satisfy it. If true, requests for a " \
+           "region's outcommod are bid on in order only until as many bids " \
+           "as the region has spent assemblies have been made, which " \
+           "greatly reduces the number of bids when many requests are " \
+           "made. No assembly is reserved for a particular request, so " \
+           "requests filled by other suppliers leave the oldest fuel to the " \
+           "rest, but requests beyond the cap are not bid on and fuel they " \
+           "would have taken waits for the next time step. If false, every " \
+           "request is bid on.", \
+    "uilabel": "Prune Spent Fuel Bids", \
+    "uitype": "bool"}
+  bool prune_bids;
+
+  #pragma cyclus var { \
+    "default": False, \
+    "tooltip": "Whether to record demand once per requested assembly", \
+    "doc": "If true, one demand time series entry of one assembly's mass " \
+           "is recorded for every assembly requested, as in earlier " \
+           "versions. If false, the total mass requested by each region is " \
+           "recorded once per time step.", \
+    "uilabel": "Per Assembly Demand Records", \
+    "uitype": "bool"}
+  bool demand_per_assembly;
+
+  #pragma cyclus var { \
+    "default": "", \
+    "tooltip": "File name prefix of the reactor's DRE trace", \
+    "doc": "If set, the reactor records the inputs of every resource " \
+           "exchange callback (requests bid on, trades and responses " \
+           "received) to a binary trace named <prefix>_<agent id>.trace, " \
+           "which the areal_replay driver can feed back through the " \
+           "reactor without the rest of the simulation.", \
+    "uilabel": "DRE Trace Prefix"}
+  std::string dre_trace;
+
+  // should be hidden in ui (internal only). One entry per region, nonzero if
+  // fuel has already been discharged from that region this cycle.
+  #pragma cyclus var {"default": [], "doc": "This should NEVER be set manually",\
                       "internal": True \
   }
-  bool discharged1;
+  std::vector<int> discharged;
+
+  #pragma cyclus var { \
+    "default": [], \
+    "uilabel": "Depletion Matrix Files", \
+    "doc": "Optional list with one entry per region naming a file that " \
+           "holds the region's transmutation matrix for one time step, or " \
+           "an empty entry for the region to transmute its fuel to its " \
+           "fuel_outrecipe. Fuel discharged from a region with a matrix is " \
+           "depleted from its fresh composition by one matrix step for " \
+           "every time step it was irradiated. Each line of the file holds " \
+           "a source nuclide, a product nuclide and the fraction of the " \
+           "source's mass converted to the product in one time step (the " \
+           "source itself for the fraction retained). The fractions of " \
+           "each source must sum to one. Nuclides with no entries are " \
+           "unchanged and lines starting with # are ignored.", \
+  }
+  std::vector<std::string> depletion_files;
 
-  #pragma cyclus var {"default": 0, "doc": "This should NEVER be set manually",\
+  #pragma cyclus var { \
+    "default": [], \
+    "uilabel": "Burnup Library Files", \
+    "doc": "Optional list with one entry per region naming a file that " \
+           "holds a library of the region's spent fuel compositions indexed " \
+           "by burnup, or an empty entry for the region not to use one. " \
+           "Fuel discharged from a region with a library is transmuted to " \
+           "the library's composition for the number of time steps it was " \
+           "irradiated, interpolating linearly between entries and holding " \
+           "the first and last entries outside them. Each line of the file " \
+           "holds a burnup in time steps, a nuclide and the nuclide's mass " \
+           "(or mass fraction) at that burnup; lines starting with # are " \
+           "ignored. A region cannot have both a depletion matrix and a " \
+           "burnup library.", \
+  }
+  std::vector<std::string> burnup_libraries;
+
+  // should be hidden in ui (internal only). One entry per region, the number
+  // of time steps the region has been irradiated for.
+  #pragma cyclus var {"default": [], "doc": "This should NEVER be set manually",\
                       "internal": True \
   }
-  bool discharged2;
+  std::vector<int> burn_steps;
 
-  // This variable should be hidden/unavailable in ui.  Maps resource object
-  // id's to the index for the incommod through which they were received.
-  #pragma cyclus var {"default": {}, "doc": "This should NEVER be set manually", \
+  // should be hidden in ui (internal only). The burn_steps count when each
+  // core assembly was loaded, region by region in core order.  Written by
+  // Snapshot from each region's core_loaded_at.
+  #pragma cyclus var {"default": [], "doc": "This should NEVER be set manually",\
                       "internal": True \
   }
-  std::map<int, int> res_indexes;
+  std::vector<int> core_loaded_at;
+
+  // shared with the prototype this reactor was cloned from, or built by
+  // InitRegions.  No need to persist.
+  boost::shared_ptr<const Spec> spec_;
+
+  // Region inventories are persisted through SnapshotInv/InitInv and the
+  // remaining members are rebuilt from the input vectors by InitRegions.
+  std::vector<Region> regions_;
+
+  // region holding each spent assembly, by object id, for regions that share
+  // their outcommod with another region, so that spent_region need not
+  // search their spent fuel.  Kept by StoreSpent and TakeSpent.
+  std::unordered_map<int, int> shared_spent_regions_;
+
+  // events recorded during the current time step, written in the Tock.
+  std::vector<Event> events_;
+
+  // open while the reactor writes a DRE trace.  Not persisted - a restarted
+  // reactor starts a new trace.
+  boost::shared_ptr<TraceWriter> trace_;
+
+  // time steps before this time are quiet (see UpdateQuietUntil).  Not
+  // persisted - the first Tock after a restart recomputes it.
+  int quiet_until_;
 
-  // populated lazily and no need to persist.
-  std::set<std::string> uniq_outcommods_;
+  // null unless built with AREAL_PROFILE, so that the reactor's layout is
+  // the same either way.  Not persisted.
+  boost::shared_ptr<Profile> profile_;
 };
 
 } // namespace areal
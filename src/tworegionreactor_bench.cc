@@ -0,0 +1,293 @@
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+
+#include "cyclus.h"
+#include "tworegionreactor.h"
+
+using pyne::nucname::id;
+using cyclus::BidPortfolio;
+using cyclus::Composition;
+using cyclus::Material;
+using cyclus::Request;
+using cyclus::RequestPortfolio;
+using cyclus::Trade;
+
+namespace areal {
+namespace tworegionreactorbench {
+
+const double kAssemSize = 300;
+
+Composition::Ptr c_uox() {
+  cyclus::CompMap m;
+  m[id("u235")] = 0.04;
+  m[id("u238")] = 0.96;
+  return Composition::CreateFromMass(m);
+};
+
+Composition::Ptr c_spentuox() {
+  cyclus::CompMap m;
+  m[id("u235")] =  .8;
+  m[id("u238")] =  100;
+  m[id("pu239")] = 1;
+  return Composition::CreateFromMass(m);
+};
+
+// Two regions of n_core / 2 assemblies each, with a third of each region
+// discharged per cycle.
+std::string Config(int n_core, int cycle_time) {
+  int n_region = std::max(1, n_core / 2);
+  int n_batch = std::max(1, n_region / 3);
+  std::stringstream ss;
+  ss << "  <fuel_inrecipes>  <val>uox</val> <val>uox</val> </fuel_inrecipes>  "
+     << "  <fuel_outrecipes> <val>spentuox</val> <val>spentuox</val> </fuel_outrecipes>  "
+     << "  <fuel_incommods>  <val>uox_a</val> <val>uox_b</val> </fuel_incommods>  "
+     << "  <fuel_outcommods> <val>spent_a</val> <val>spent_b</val> </fuel_outcommods>  "
+     << "  <cycle_time>" << cycle_time << "</cycle_time>  "
+     << "  <refuel_time>0</refuel_time>  "
+     << "  <assem_size> <val>" << kAssemSize << "</val> <val>" << kAssemSize
+     << "</val> </assem_size>  "
+     << "  <n_assem_region> <val>" << n_region << "</val> <val>" << n_region
+     << "</val> </n_assem_region>  "
+     << "  <n_assem_batch> <val>" << n_batch << "</val> <val>" << n_batch
+     << "</val> </n_assem_batch>  ";
+  return ss.str();
+}
+
+// Builds reactors straight from a MockSim prototype so that individual agent
+// callbacks can be timed without running the rest of the simulation.
+class ReactorBench {
+ public:
+  ReactorBench(int n_core, int cycle_time)
+      : sim_(cyclus::AgentSpec(":areal:TwoRegionReactor"),
+             Config(n_core, cycle_time), 10) {
+    sim_.AddRecipe("uox", c_uox());
+    sim_.AddRecipe("spentuox", c_spentuox());
+  }
+
+  // Builds a reactor with n_loaded core and n_spent spent assemblies split
+  // evenly between its two regions.
+  TwoRegionReactor* Build(int n_loaded, int n_spent) {
+    TwoRegionReactor* r =
+        static_cast<TwoRegionReactor*>(sim_.agent->Clone());
+    r->Build(NULL);
+    cyclus::Inventories invs;
+    invs["core1"] = Assemblies(r, n_loaded / 2, "uox");
+    invs["core2"] = Assemblies(r, n_loaded - n_loaded / 2, "uox");
+    invs["spent1"] = Assemblies(r, n_spent / 2, "spentuox");
+    invs["spent2"] = Assemblies(r, n_spent - n_spent / 2, "spentuox");
+    r->InitInv(invs);
+    return r;
+  }
+
+  void Discard(TwoRegionReactor* r) {
+    r->context()->UnregisterTrader(r);
+    delete r;
+  }
+
+  std::vector<cyclus::Resource::Ptr> Assemblies(TwoRegionReactor* r, int n,
+                                                std::string recipe) {
+    Composition::Ptr c = r->context()->GetRecipe(recipe);
+    std::vector<cyclus::Resource::Ptr> mats;
+    for (int i = 0; i < n; i++) {
+      mats.push_back(Material::Create(r, kAssemSize, c));
+    }
+    return mats;
+  }
+
+ private:
+  cyclus::MockSim sim_;
+};
+
+// core sizes in assemblies
+void CoreSizes(benchmark::internal::Benchmark* b) {
+  int sizes[] = {10, 100, 1000, 10000, 50000};
+  for (int i = 0; i < 5; i++) {
+    b->Arg(sizes[i]);
+  }
+}
+
+// spent pool sizes in assemblies with 1 and 100 requests for spent fuel
+void SpentSizes(benchmark::internal::Benchmark* b) {
+  int sizes[] = {10, 1000, 100000};
+  for (int i = 0; i < 3; i++) {
+    b->Args({sizes[i], 1});
+    b->Args({sizes[i], 100});
+  }
+}
+
+// Tick of a full core that is mid-cycle.
+void BM_TickMidCycle(benchmark::State& state) {
+  ReactorBench bench(state.range(0), 1000000);
+  TwoRegionReactor* r = bench.Build(state.range(0), 0);
+  for (auto _ : state) {
+    r->Tick();
+  }
+  bench.Discard(r);
+}
+BENCHMARK(BM_TickMidCycle)->Apply(CoreSizes);
+
+// Tick that ends a cycle: transmutes and discharges a batch from each region
+// and loads any fresh fuel.  Transmute is timed through this Tick.
+void BM_TickCycleEnd(benchmark::State& state) {
+  ReactorBench bench(state.range(0), 1);
+  for (auto _ : state) {
+    state.PauseTiming();
+    TwoRegionReactor* r = bench.Build(state.range(0), 0);
+    r->Tock();
+    state.ResumeTiming();
+    r->Tick();
+    state.PauseTiming();
+    bench.Discard(r);
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_TickCycleEnd)->Apply(CoreSizes);
+
+// Tock that starts a cycle with a full core: records the cycle start and
+// power, irradiates the core and works out how long it stays quiet.
+void BM_Tock(benchmark::State& state) {
+  ReactorBench bench(state.range(0), 1000000);
+  for (auto _ : state) {
+    state.PauseTiming();
+    TwoRegionReactor* r = bench.Build(state.range(0), 0);
+    state.ResumeTiming();
+    r->Tock();
+    state.PauseTiming();
+    bench.Discard(r);
+    state.ResumeTiming();
+  }
+}
+BENCHMARK(BM_Tock)->Apply(CoreSizes);
+
+// Quiet Tocks of a full core that is mid-cycle, which only record power.
+// Simulation time does not advance outside of a run, so each iteration takes
+// a new reactor through the rest of one cycle rather than letting its
+// cycle_step run past the end of the cycle.
+void BM_TockQuiet(benchmark::State& state) {
+  const int cycle_time = 100;
+  ReactorBench bench(state.range(0), cycle_time);
+  for (auto _ : state) {
+    state.PauseTiming();
+    TwoRegionReactor* r = bench.Build(state.range(0), 0);
+    r->Tock();  // starts the cycle
+    state.ResumeTiming();
+    for (int i = 1; i < cycle_time; i++) {
+      r->Tock();
+    }
+    state.PauseTiming();
+    bench.Discard(r);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * (cycle_time - 1));
+}
+BENCHMARK(BM_TockQuiet)->Apply(CoreSizes);
+
+// Requests to fill an empty core.
+void BM_GetMatlRequests(benchmark::State& state) {
+  ReactorBench bench(state.range(0), 1000000);
+  TwoRegionReactor* r = bench.Build(0, 0);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(r->GetMatlRequests());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  bench.Discard(r);
+}
+BENCHMARK(BM_GetMatlRequests)->Apply(CoreSizes);
+
+// Bids on range(1) single assembly requests for each region's outcommod
+// from a spent pool of range(0) assemblies.
+void BM_GetMatlBids(benchmark::State& state) {
+  ReactorBench bench(10, 1000000);
+  TwoRegionReactor* r = bench.Build(10, state.range(0));
+
+  RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
+  cyclus::CommodMap<Material>::type commod_requests;
+  Material::Ptr target = Material::CreateUntracked(
+      kAssemSize, r->context()->GetRecipe("spentuox"));
+  for (int i = 0; i < state.range(1); i++) {
+    commod_requests["spent_a"].push_back(
+        port->AddRequest(target, r, "spent_a"));
+    commod_requests["spent_b"].push_back(
+        port->AddRequest(target, r, "spent_b"));
+  }
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(r->GetMatlBids(commod_requests));
+  }
+  bench.Discard(r);
+}
+BENCHMARK(BM_GetMatlBids)->Apply(SpentSizes);
+
+// Fills range(1) trades for each region's outcommod from a spent pool of
+// range(0) assemblies.  The traded assemblies are returned to the spent
+// inventory between iterations.
+void BM_GetMatlTrades(benchmark::State& state) {
+  ReactorBench bench(10, 1000000);
+  TwoRegionReactor* r = bench.Build(10, state.range(0));
+  int n_trade = std::min<int>(state.range(1), state.range(0) / 2);
+
+  RequestPortfolio<Material>::Ptr rport(new RequestPortfolio<Material>());
+  BidPortfolio<Material>::Ptr bport(new BidPortfolio<Material>());
+  std::vector<Trade<Material> > trades;
+  Material::Ptr m = Material::CreateUntracked(
+      kAssemSize, r->context()->GetRecipe("spentuox"));
+  std::string commods[] = {"spent_a", "spent_b"};
+  for (int i = 0; i < n_trade; i++) {
+    for (int j = 0; j < 2; j++) {
+      Request<Material>* req = rport->AddRequest(m, r, commods[j]);
+      trades.push_back(Trade<Material>(req, bport->AddBid(req, m, r),
+                                       kAssemSize));
+    }
+  }
+
+  for (auto _ : state) {
+    std::vector<std::pair<Trade<Material>, Material::Ptr> > responses;
+    r->GetMatlTrades(trades, responses);
+
+    state.PauseTiming();
+    cyclus::Inventories invs;
+    for (int j = 0; j < responses.size(); j++) {
+      std::string commod = responses[j].first.request->commodity();
+      invs[commod == "spent_a" ? "spent1" : "spent2"].push_back(
+          responses[j].second);
+    }
+    r->InitInv(invs);
+    state.ResumeTiming();
+  }
+  bench.Discard(r);
+}
+BENCHMARK(BM_GetMatlTrades)->Apply(SpentSizes);
+
+// Accepts enough fresh assemblies to fill an empty core.
+void BM_AcceptMatlTrades(benchmark::State& state) {
+  ReactorBench bench(state.range(0), 1000000);
+  for (auto _ : state) {
+    state.PauseTiming();
+    TwoRegionReactor* r = bench.Build(0, 0);
+    RequestPortfolio<Material>::Ptr rport(new RequestPortfolio<Material>());
+    BidPortfolio<Material>::Ptr bport(new BidPortfolio<Material>());
+    std::vector<cyclus::Resource::Ptr> mats =
+        bench.Assemblies(r, state.range(0), "uox");
+    std::vector<std::pair<Trade<Material>, Material::Ptr> > responses;
+    for (int j = 0; j < mats.size(); j++) {
+      Material::Ptr m = cyclus::ResCast<Material>(mats[j]);
+      Request<Material>* req =
+          rport->AddRequest(m, r, j % 2 == 0 ? "uox_a" : "uox_b");
+      Trade<Material> trade(req, bport->AddBid(req, m, r), kAssemSize);
+      responses.push_back(std::make_pair(trade, m));
+    }
+    state.ResumeTiming();
+
+    r->AcceptMatlTrades(responses);
+
+    state.PauseTiming();
+    bench.Discard(r);
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AcceptMatlTrades)->Apply(CoreSizes);
+
+}  // namespace tworegionreactorbench
+}  // namespace areal
@@ -0,0 +1,212 @@
+#include "tworegionreactor_replay.h"
+
+#include <limits>
+
+using cyclus::BidPortfolio;
+using cyclus::Composition;
+using cyclus::Material;
+using cyclus::Request;
+using cyclus::RequestPortfolio;
+using cyclus::Trade;
+using cyclus::ValueError;
+
+namespace areal {
+
+TraceReplay::TraceReplay(const std::string& path)
+    : end_(-1), ctx_(NULL), agent_(NULL), trader_(NULL) {
+  for (int p = 0; p < N_PHASES; p++) {
+    seconds_[p] = 0;
+    calls_[p] = 0;
+  }
+
+  TraceReader r(path);
+  header_.Read(&r);
+  TraceKind kind;
+  while (r.Next(&kind)) {
+    if (kind == TRACE_COMP) {
+      int index = r.Int();
+      if (index != comps_.size()) {
+        throw ValueError("areal::TraceReplay compositions out of order in " +
+                         path);
+      }
+      comps_.push_back(Composition::CreateFromMass(r.Comp()));
+      continue;
+    }
+
+    int time = r.Int();
+    if (kind == TRACE_END) {
+      end_ = time;
+      continue;
+    }
+    Step& s = steps_[time];
+    int n = r.Int();
+    if (kind == TRACE_BIDS) {
+      for (int i = 0; i < n; i++) {
+        std::vector<double>& qtys = s.bids[r.String()];
+        int n_req = r.Int();
+        for (int j = 0; j < n_req; j++) {
+          qtys.push_back(r.Double());
+        }
+      }
+    } else if (kind == TRACE_TRADES) {
+      s.traded = true;
+      s.trades.resize(n);
+      for (int j = 0; j < n; j++) {
+        s.trades[j].commod = r.String();
+        s.trades[j].region = r.Int();
+        s.trades[j].pos = r.Int();
+        s.trades[j].amt = r.Double();
+      }
+    } else if (kind == TRACE_ACCEPT) {
+      s.accepted = true;
+      s.accepts.resize(n);
+      for (int j = 0; j < n; j++) {
+        s.accepts[j].commod = r.String();
+        s.accepts[j].comp = r.Int();
+        s.accepts[j].qty = r.Double();
+      }
+    } else {
+      throw ValueError("areal::TraceReplay unknown record in " + path);
+    }
+  }
+
+  cyclus::AgentSpec spec(":areal:TwoRegionReactor");
+  if (header_.lifetime == -1) {
+    sim_.reset(new cyclus::MockSim(spec, header_.config, header_.duration));
+  } else {
+    sim_.reset(new cyclus::MockSim(spec, header_.config, header_.duration,
+                                   header_.lifetime));
+  }
+  std::map<std::string, cyclus::CompMap>::iterator it;
+  for (it = header_.recipes.begin(); it != header_.recipes.end(); ++it) {
+    Composition::Ptr c = Composition::CreateFromMass(it->second);
+    sim_->AddRecipe(it->first, c);
+    if (!target_comp_) {
+      target_comp_ = c;
+    }
+  }
+  ctx_ = sim_->agent->context();
+}
+
+int TraceReplay::Run() {
+  ctx_->RegisterTimeListener(this);
+  return sim_->Run();
+}
+
+const int TraceReplay::id() const {
+  return std::numeric_limits<int>::max();
+}
+
+void TraceReplay::Tick() {
+  if (end_ >= 0 && ctx_->time() > end_) {
+    return;  // the reactor has been decommissioned
+  }
+  if (trader_ == NULL) {
+    // the reactor is the only trader in the MockSim.  Withdraw it from the
+    // exchange so that its callbacks are only called by the replay.
+    const std::set<cyclus::Trader*>& traders = ctx_->traders();
+    if (traders.size() != 1) {
+      throw ValueError("areal::TraceReplay cannot find the replayed reactor");
+    }
+    trader_ = *traders.begin();
+    agent_ = trader_->manager();
+    ctx_->UnregisterTrader(trader_);
+  }
+
+  std::map<int, Step>::const_iterator it = steps_.find(ctx_->time());
+  const Step* s = it == steps_.end() ? NULL : &it->second;
+
+  Start();
+  std::set<RequestPortfolio<Material>::Ptr> reqs = trader_->GetMatlRequests();
+  Stop(REQUESTS);
+
+  Bids(s);
+  if (s != NULL && s->traded) {
+    Trades(*s);
+  }
+  if (s != NULL && s->accepted) {
+    Accept(*s);
+  }
+}
+
+void TraceReplay::Bids(const Step* s) {
+  RequestPortfolio<Material>::Ptr port(new RequestPortfolio<Material>());
+  cyclus::CommodMap<Material>::type commod_requests;
+  if (s != NULL) {
+    std::map<std::string, std::vector<double> >::const_iterator it;
+    for (it = s->bids.begin(); it != s->bids.end(); ++it) {
+      for (int j = 0; j < it->second.size(); j++) {
+        Material::Ptr target =
+            Material::CreateUntracked(it->second[j], target_comp_);
+        commod_requests[it->first].push_back(
+            port->AddRequest(target, trader_, it->first));
+      }
+    }
+  }
+
+  Start();
+  std::set<BidPortfolio<Material>::Ptr> bids =
+      trader_->GetMatlBids(commod_requests);
+  Stop(BIDS);
+}
+
+void TraceReplay::Trades(const Step& s) {
+  // each trade is for the assembly at the recorded position in its region's
+  // spent fuel, which the reactor has in the same order as when traced
+  cyclus::Inventories invs = agent_->SnapshotInv();
+  RequestPortfolio<Material>::Ptr rport(new RequestPortfolio<Material>());
+  BidPortfolio<Material>::Ptr bport(new BidPortfolio<Material>());
+  std::vector<Trade<Material> > trades;
+  for (int j = 0; j < s.trades.size(); j++) {
+    const TradeRecord& t = s.trades[j];
+    std::stringstream ss;
+    ss << "spent" << t.region + 1;
+    std::vector<cyclus::Resource::Ptr>& spent = invs[ss.str()];
+    if (t.pos >= spent.size()) {
+      throw ValueError("areal::TraceReplay trade for an assembly the "
+                       "replayed reactor does not have");
+    }
+    Material::Ptr m = cyclus::ResCast<Material>(spent[t.pos]);
+    Request<Material>* req = rport->AddRequest(m, trader_, t.commod);
+    trades.push_back(Trade<Material>(req, bport->AddBid(req, m, trader_),
+                                     t.amt));
+  }
+
+  std::vector<std::pair<Trade<Material>, Material::Ptr> > responses;
+  Start();
+  trader_->GetMatlTrades(trades, responses);
+  Stop(TRADES);
+}
+
+void TraceReplay::Accept(const Step& s) {
+  RequestPortfolio<Material>::Ptr rport(new RequestPortfolio<Material>());
+  BidPortfolio<Material>::Ptr bport(new BidPortfolio<Material>());
+  std::vector<std::pair<Trade<Material>, Material::Ptr> > responses;
+  for (int j = 0; j < s.accepts.size(); j++) {
+    const AcceptRecord& a = s.accepts[j];
+    if (a.comp < 0 || a.comp >= comps_.size()) {
+      throw ValueError("areal::TraceReplay response with an unknown "
+                       "composition");
+    }
+    Material::Ptr m = Material::Create(agent_, a.qty, comps_[a.comp]);
+    Request<Material>* req = rport->AddRequest(m, trader_, a.commod);
+    Trade<Material> trade(req, bport->AddBid(req, m, trader_), a.qty);
+    responses.push_back(std::make_pair(trade, m));
+  }
+
+  Start();
+  trader_->AcceptMatlTrades(responses);
+  Stop(ACCEPT);
+}
+
+void TraceReplay::Start() {
+  start_ = std::chrono::steady_clock::now();
+}
+
+void TraceReplay::Stop(Phase p) {
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start_;
+  seconds_[p] += dt.count();
+  ++calls_[p];
+}
+
+}  // namespace areal
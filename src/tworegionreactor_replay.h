@@ -0,0 +1,106 @@
+#ifndef AREAL_SRC_TWOREGIONREACTOR_REPLAY_H_
+#define AREAL_SRC_TWOREGIONREACTOR_REPLAY_H_
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cyclus.h"
+#include "dre_trace.h"
+
+namespace areal {
+
+/// Replays the DRE trace of a TwoRegionReactor (see its dre_trace option)
+/// without the rest of the simulation it was recorded in.  A reactor is
+/// built from the trace's config in a MockSim of the traced duration and
+/// runs its own Tick and Tock, but takes no part in the MockSim's resource
+/// exchange.  Instead, between its Tick and Tock each time step, the replay
+/// calls its DRE callbacks with the inputs recorded on that time step.
+class TraceReplay : public cyclus::TimeListener {
+ public:
+  enum Phase {REQUESTS, BIDS, TRADES, ACCEPT, N_PHASES};
+
+  /// Reads the trace at path.
+  explicit TraceReplay(const std::string& path);
+  virtual ~TraceReplay() {}
+
+  /// Runs the replay and returns the id of the replayed reactor in db().
+  int Run();
+
+  /// The replay's output database.
+  cyclus::SqliteBack& db() { return sim_->db(); }
+
+  /// Wall time and number of calls of each of the reactor's DRE callbacks
+  /// during the replay.
+  double seconds(Phase p) const { return seconds_[p]; }
+  int calls(Phase p) const { return calls_[p]; }
+
+  /// Larger than any agent id, so that the replay ticks after the reactor.
+  virtual const int id() const;
+
+  /// Calls the reactor's DRE callbacks for this time step.
+  virtual void Tick();
+  virtual void Tock() {}
+
+ private:
+  struct TradeRecord {
+    std::string commod;
+    int region;
+    int pos;
+    double amt;
+  };
+
+  struct AcceptRecord {
+    std::string commod;
+    int comp;
+    double qty;
+  };
+
+  /// The recorded inputs of one time step.
+  struct Step {
+    Step() : traded(false), accepted(false) {}
+
+    // request target quantities by commodity
+    std::map<std::string, std::vector<double> > bids;
+    bool traded;
+    std::vector<TradeRecord> trades;
+    bool accepted;
+    std::vector<AcceptRecord> accepts;
+  };
+
+  void Bids(const Step* s);
+  void Trades(const Step& s);
+  void Accept(const Step& s);
+
+  /// Starts timing a callback.
+  void Start();
+
+  /// Adds the time since Start to the phase.
+  void Stop(Phase p);
+
+  TraceHeader header_;
+  std::map<int, Step> steps_;
+
+  // time step the reactor was decommissioned on, or -1
+  int end_;
+  std::vector<cyclus::Composition::Ptr> comps_;
+
+  boost::shared_ptr<cyclus::MockSim> sim_;
+  cyclus::Context* ctx_;
+
+  // the replayed reactor, found on the first Tick
+  cyclus::Agent* agent_;
+  cyclus::Trader* trader_;
+
+  // target composition of replayed requests, which the reactor never reads
+  cyclus::Composition::Ptr target_comp_;
+
+  double seconds_[N_PHASES];
+  int calls_[N_PHASES];
+  std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace areal
+
+#endif  // AREAL_SRC_TWOREGIONREACTOR_REPLAY_H_
@@ -1,8 +1,17 @@
 #include <gtest/gtest.h>
 
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
 #include <sstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
 
 #include "cyclus.h"
+#include "sim_init.h"
+#include "tworegionreactor_replay.h"
 
 using pyne::nucname::id;
 using cyclus::Composition;
@@ -52,6 +61,30 @@ Composition::Ptr c_water() {
   return Composition::CreateFromAtom(m);
 };
 
+// A new, uniquely named directory in the system temp directory that is
+// removed with everything in it when the test using it ends, pass or fail.
+class TempDir {
+ public:
+  TempDir() {
+    namespace fs = boost::filesystem;
+    path_ = fs::temp_directory_path() /
+            fs::unique_path("areal-test-%%%%-%%%%-%%%%");
+    fs::create_directories(path_);
+  }
+  ~TempDir() {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(path_, ec);
+  }
+
+  /// Returns the path of a file named name in the directory.
+  std::string file(const std::string& name) const {
+    return (path_ / name).string();
+  }
+
+ private:
+  boost::filesystem::path path_;
+};
+
 // Test that with a zero refuel_time and a zero capacity fresh fuel buffer
 // (the default), fuel can be ordered and the cycle started with no time step
 // delay.
@@ -139,6 +172,761 @@ TEST(TwoRegionReactorTests, BatchSizes) {
   EXPECT_EQ(14+2*(simdur-1), qr.rows.size());
 }
 
+// tests that demand is recorded once per region and time step with the total
+// mass requested, or once per assembly when demand_per_assembly is set.
+TEST(TwoRegionReactorTests, DemandTimeSeries) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_region> <val>7</val> <val>14</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>2</val> </n_assem_batch>  ";
+
+  int simdur = 10;
+  for (int per_assem = 0; per_assem < 2; per_assem++) {
+    std::string opt = per_assem ?
+        "  <demand_per_assembly>1</demand_per_assembly>  " : "";
+    cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"),
+                        config + opt, simdur);
+    sim.AddSource("uox").Finalize();
+    sim.AddSource("mox").Finalize();
+    sim.AddRecipe("uox", c_uox());
+    sim.AddRecipe("mox", c_mox());
+    sim.AddRecipe("spentuox", c_spentuox());
+    sim.AddRecipe("spentmox", c_spentmox());
+    int id = sim.Run();
+
+    // 7 for initial core, 3 per time step for each new batch in region 1
+    QueryResult qr = sim.db().Query("TimeSeriesdemanduox", NULL);
+    if (per_assem) {
+      EXPECT_EQ(7 + 3 * (simdur - 1), qr.rows.size());
+      continue;
+    }
+    ASSERT_EQ(simdur, qr.rows.size());
+    double tot = 0;
+    for (int i = 0; i < qr.rows.size(); i++) {
+      tot += qr.GetVal<double>("Value", i);
+    }
+    EXPECT_DOUBLE_EQ(7 + 3 * (simdur - 1), tot);
+
+    std::vector<Cond> conds;
+    conds.push_back(Cond("Time", "==", 0));
+    qr = sim.db().Query("TimeSeriesdemandmox", &conds);
+    ASSERT_EQ(1, qr.rows.size());
+    EXPECT_DOUBLE_EQ(14 * 2.0, qr.GetVal<double>("Value"));
+  }
+}
+
+#ifdef AREAL_PROFILE
+// tests that a profiled build writes one TwoRegionReactorProfile row per phase
+// whose calls and items match the simulation.
+TEST(TwoRegionReactorTests, ProfileTable) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_region> <val>7</val> <val>14</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>2</val> </n_assem_batch>  ";
+
+  int simdur = 10;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                      simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddSink("spentuox").Finalize();
+  sim.AddSink("spentmox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("ReceiverId", "==", id));
+  int n_received = sim.db().Query("Transactions", &conds).rows.size();
+  conds[0] = Cond("SenderId", "==", id);
+  int n_sent = sim.db().Query("Transactions", &conds).rows.size();
+  ASSERT_GT(n_received, 0);
+  ASSERT_GT(n_sent, 0);
+
+  conds[0] = Cond("AgentId", "==", id);
+  QueryResult qr = sim.db().Query("TwoRegionReactorProfile", &conds);
+  ASSERT_EQ(6, qr.rows.size());
+  std::map<std::string, int> calls;
+  std::map<std::string, int> items;
+  for (int i = 0; i < qr.rows.size(); i++) {
+    std::string phase = qr.GetVal<std::string>("Phase", i);
+    calls[phase] = qr.GetVal<int>("Calls", i);
+    items[phase] = qr.GetVal<int>("Items", i);
+    EXPECT_GE(qr.GetVal<double>("Seconds", i), 0) << phase;
+  }
+
+  EXPECT_EQ(simdur, calls["Tick"]);
+  EXPECT_EQ(simdur, calls["Tock"]);
+  EXPECT_EQ(simdur, calls["GetMatlRequests"]);
+  EXPECT_EQ(simdur, calls["GetMatlBids"]);
+  EXPECT_GE(items["GetMatlRequests"], n_received);
+  EXPECT_GE(items["GetMatlBids"], n_sent);
+  EXPECT_EQ(n_sent, items["GetMatlTrades"]);
+  EXPECT_EQ(n_received, items["AcceptMatlTrades"]);
+}
+#endif
+
+// tests that GetMatlRequests and GetMatlBids can be called concurrently for
+// many reactors, and that they construct no capacity constraints, whose ids
+// come from a process-wide counter.  Configure with
+// -DUSE_THREAD_SANITIZER=ON to also have any data race between the calls
+// reported.
+TEST(TwoRegionReactorTests, ConcurrentRequestsAndBids) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>4</val> <val>4</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  "
+     "  <aggregate_requests>1</aggregate_requests>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 10);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  cyclus::Context* ctx = sim.agent->context();
+
+  // every reactor has one of four assemblies loaded in region 1, an empty
+  // region 2 and three spent assemblies in each region
+  int n_reactors = 64;
+  std::vector<cyclus::Trader*> reactors;
+  for (int i = 0; i < n_reactors; i++) {
+    cyclus::Agent* a = sim.agent->Clone();
+    a->Build(NULL);
+    cyclus::Inventories invs;
+    invs["core1"].push_back(Material::Create(a, 1, ctx->GetRecipe("uox")));
+    for (int j = 0; j < 3; j++) {
+      invs["spent1"].push_back(
+          Material::Create(a, 1, ctx->GetRecipe("spentuox")));
+      invs["spent2"].push_back(
+          Material::Create(a, 1, ctx->GetRecipe("spentmox")));
+    }
+    a->InitInv(invs);
+    reactors.push_back(dynamic_cast<cyclus::Trader*>(a));
+  }
+
+  // five single assembly requests on each outcommod, shared by all reactors
+  cyclus::RequestPortfolio<Material>::Ptr port(
+      new cyclus::RequestPortfolio<Material>());
+  cyclus::CommodMap<Material>::type commod_requests;
+  std::string outcommods[] = {"spentuox", "spentmox"};
+  for (int c = 0; c < 2; c++) {
+    Material::Ptr target =
+        Material::CreateUntracked(1, ctx->GetRecipe(outcommods[c]));
+    for (int j = 0; j < 5; j++) {
+      commod_requests[outcommods[c]].push_back(
+          port->AddRequest(target, reactors[0], outcommods[c]));
+    }
+  }
+
+  cyclus::CapacityConstraint<Material> before(1);
+  int n_threads = 8;
+  std::vector<int> n_requests(n_reactors, 0);
+  std::vector<int> n_bids(n_reactors, 0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      for (int rep = 0; rep < 10; rep++) {
+        for (int i = t; i < n_reactors; i += n_threads) {
+          std::set<cyclus::RequestPortfolio<Material>::Ptr> reqs =
+              reactors[i]->GetMatlRequests();
+          std::set<cyclus::BidPortfolio<Material>::Ptr> bids =
+              reactors[i]->GetMatlBids(commod_requests);
+
+          n_requests[i] = 0;
+          std::set<cyclus::RequestPortfolio<Material>::Ptr>::iterator rit;
+          for (rit = reqs.begin(); rit != reqs.end(); ++rit) {
+            n_requests[i] += (*rit)->requests().size();
+          }
+          n_bids[i] = 0;
+          std::set<cyclus::BidPortfolio<Material>::Ptr>::iterator bit;
+          for (bit = bids.begin(); bit != bids.end(); ++bit) {
+            n_bids[i] += (*bit)->bids().size();
+          }
+        }
+      }
+    }));
+  }
+  for (int t = 0; t < n_threads; t++) {
+    threads[t].join();
+  }
+  cyclus::CapacityConstraint<Material> after(1);
+  EXPECT_EQ(before.id() + 1, after.id());
+
+  for (int i = 0; i < n_reactors; i++) {
+    EXPECT_EQ(3 + 4, n_requests[i]);
+    EXPECT_EQ(2 * 5, n_bids[i]);
+  }
+}
+
+// tests that clones of a prototype share its spec, so that their requests
+// for the same fuel have the same target material.
+TEST(TwoRegionReactorTests, ClonesShareSpec) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>2</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 10);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+
+  std::map<std::string, std::set<Material*> > targets;
+  for (int i = 0; i < 3; i++) {
+    cyclus::Agent* a = sim.agent->Clone();
+    a->Build(NULL);
+    std::set<cyclus::RequestPortfolio<Material>::Ptr> ports =
+        dynamic_cast<cyclus::Trader*>(a)->GetMatlRequests();
+    std::set<cyclus::RequestPortfolio<Material>::Ptr>::iterator it;
+    for (it = ports.begin(); it != ports.end(); ++it) {
+      for (int j = 0; j < (*it)->requests().size(); j++) {
+        cyclus::Request<Material>* req = (*it)->requests()[j];
+        targets[req->commodity()].insert(req->target().get());
+      }
+    }
+  }
+
+  ASSERT_EQ(2, targets.size());
+  EXPECT_EQ(1, targets["uox"].size());
+  EXPECT_EQ(1, targets["mox"].size());
+}
+
+// tests that placing requests in steady state creates no materials - every
+// request reuses its region's target.  Resource object ids are handed out
+// in sequence, so no material was created between two probe materials whose
+// ids are consecutive.
+TEST(TwoRegionReactorTests, RequestTargetsNotAllocated) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>50</val> <val>50</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>10</val> <val>10</val> </n_assem_batch>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 10);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  Composition::Ptr probe_comp = c_uox();
+
+  cyclus::Agent* a = sim.agent->Clone();
+  a->Build(NULL);
+  cyclus::Trader* r = dynamic_cast<cyclus::Trader*>(a);
+  r->GetMatlRequests();  // warm up
+
+  int n_requests = 0;
+  Material::Ptr before = Material::CreateUntracked(1, probe_comp);
+  for (int step = 0; step < 20; step++) {
+    std::set<cyclus::RequestPortfolio<Material>::Ptr> ports =
+        r->GetMatlRequests();
+    std::set<cyclus::RequestPortfolio<Material>::Ptr>::iterator it;
+    for (it = ports.begin(); it != ports.end(); ++it) {
+      n_requests += (*it)->requests().size();
+    }
+  }
+  Material::Ptr after = Material::CreateUntracked(1, probe_comp);
+
+  EXPECT_EQ(20 * 100, n_requests);
+  EXPECT_EQ(before->obj_id() + 1, after->obj_id());
+}
+
+// tests that trades are filled with the oldest spent assemblies of the
+// traded region, and that the rest of its spent fuel keeps its order.
+TEST(TwoRegionReactorTests, TradesOldestSpentFirst) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>1</val> <val>1</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 10);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  cyclus::Context* ctx = sim.agent->context();
+
+  cyclus::Agent* a = sim.agent->Clone();
+  a->Build(NULL);
+  cyclus::Inventories invs;
+  std::vector<Material::Ptr> spent;
+  for (int j = 0; j < 5; j++) {
+    spent.push_back(Material::Create(a, 1, ctx->GetRecipe("spentuox")));
+    invs["spent1"].push_back(spent.back());
+  }
+  invs["spent2"].push_back(Material::Create(a, 1, ctx->GetRecipe("spentmox")));
+  a->InitInv(invs);
+  cyclus::Trader* r = dynamic_cast<cyclus::Trader*>(a);
+
+  // two trades on region 1's outcommod, both bid with its newest assembly
+  cyclus::RequestPortfolio<Material>::Ptr rport(
+      new cyclus::RequestPortfolio<Material>());
+  cyclus::BidPortfolio<Material>::Ptr bport(
+      new cyclus::BidPortfolio<Material>());
+  std::vector<cyclus::Trade<Material> > trades;
+  for (int j = 0; j < 2; j++) {
+    cyclus::Request<Material>* req =
+        rport->AddRequest(spent.back(), r, "spentuox");
+    trades.push_back(cyclus::Trade<Material>(
+        req, bport->AddBid(req, spent.back(), r), 1));
+  }
+  std::vector<std::pair<cyclus::Trade<Material>, Material::Ptr> > responses;
+  r->GetMatlTrades(trades, responses);
+
+  ASSERT_EQ(2, responses.size());
+  EXPECT_EQ(spent[0], responses[0].second);
+  EXPECT_EQ(spent[1], responses[1].second);
+
+  cyclus::Inventories left = a->SnapshotInv();
+  ASSERT_EQ(3, left["spent1"].size());
+  for (int j = 0; j < 3; j++) {
+    EXPECT_EQ(spent[j + 2]->obj_id(), left["spent1"][j]->obj_id());
+  }
+  EXPECT_EQ(1, left["spent2"].size());
+}
+
+// tests that a reactor's inventories survive a snapshot and restore in the
+// order they are used, and that taking a snapshot leaves them unchanged.
+TEST(TwoRegionReactorTests, SnapshotInvRoundTrip) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_fresh> <val>2</val> <val>0</val> </n_assem_fresh>  "
+     "  <n_assem_region> <val>4</val> <val>4</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 10);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  cyclus::Context* ctx = sim.agent->context();
+
+  cyclus::Agent* a = sim.agent->Clone();
+  a->Build(NULL);
+  cyclus::Inventories invs;
+  invs["fresh1"].push_back(Material::Create(a, 1, ctx->GetRecipe("uox")));
+  for (int j = 0; j < 3; j++) {
+    invs["core1"].push_back(Material::Create(a, 1, ctx->GetRecipe("uox")));
+    invs["core2"].push_back(Material::Create(a, 1, ctx->GetRecipe("mox")));
+    invs["spent2"].push_back(
+        Material::Create(a, 1, ctx->GetRecipe("spentmox")));
+  }
+  a->InitInv(invs);
+
+  cyclus::Agent* b = sim.agent->Clone();
+  b->Build(NULL);
+  cyclus::Inventories snap = a->SnapshotInv();
+  b->InitInv(snap);
+
+  cyclus::Inventories snap_a = a->SnapshotInv();
+  cyclus::Inventories snap_b = b->SnapshotInv();
+  cyclus::Inventories::iterator it;
+  for (it = invs.begin(); it != invs.end(); ++it) {
+    const std::vector<cyclus::Resource::Ptr>& want = it->second;
+    ASSERT_EQ(want.size(), snap_a[it->first].size()) << it->first;
+    ASSERT_EQ(want.size(), snap_b[it->first].size()) << it->first;
+    for (int j = 0; j < want.size(); j++) {
+      EXPECT_EQ(want[j]->obj_id(), snap_a[it->first][j]->obj_id());
+      EXPECT_EQ(want[j]->obj_id(), snap_b[it->first][j]->obj_id());
+    }
+  }
+  EXPECT_TRUE(snap_b["spent1"].empty());
+  EXPECT_TRUE(snap_b["fresh2"].empty());
+}
+
+// Returns the quantity and nuclide mass fractions of a resource, looked up in
+// the first of dbs that recorded it.  Doubles are written as hexfloats so
+// that entries only match if they are bit-identical.
+std::string ResourceEntry(const std::vector<cyclus::QueryableBackend*>& dbs,
+                          int res_id) {
+  std::vector<Cond> conds;
+  conds.push_back(Cond("ResourceId", "==", res_id));
+  for (int d = 0; d < dbs.size(); d++) {
+    QueryResult qr = dbs[d]->Query("Resources", &conds);
+    if (qr.rows.size() == 0) {
+      continue;
+    }
+    std::stringstream ss;
+    ss << std::hexfloat << qr.GetVal<double>("Quantity");
+
+    std::vector<Cond> qual;
+    qual.push_back(Cond("QualId", "==", qr.GetVal<int>("QualId")));
+    for (int e = 0; e < dbs.size(); e++) {
+      QueryResult comp = dbs[e]->Query("Compositions", &qual);
+      if (comp.rows.size() == 0) {
+        continue;
+      }
+      std::map<int, double> fracs;
+      for (int k = 0; k < comp.rows.size(); k++) {
+        fracs[comp.GetVal<int>("NucId", k)] =
+            comp.GetVal<double>("MassFrac", k);
+      }
+      std::map<int, double>::iterator it;
+      for (it = fracs.begin(); it != fracs.end(); ++it) {
+        ss << " " << it->first << ":" << it->second;
+      }
+      return ss.str();
+    }
+    ADD_FAILURE() << "no composition recorded for resource " << res_id;
+    return ss.str();
+  }
+  ADD_FAILURE() << "resource " << res_id << " was not recorded";
+  return "";
+}
+
+// Returns every event, power and transaction entry of a reactor from time t0
+// on, keyed by time so that two runs can be compared.  Doubles are written as
+// hexfloats, and each transaction carries the traded resource's quantity and
+// composition.  Resources are looked up in db and then in res_db, the
+// simulation a restarted run was taken from, if given.
+std::multiset<std::string> Trajectory(cyclus::QueryableBackend& db, int id,
+                                      int t0,
+                                      cyclus::QueryableBackend* res_db = NULL) {
+  std::vector<cyclus::QueryableBackend*> dbs(1, &db);
+  if (res_db != NULL) {
+    dbs.push_back(res_db);
+  }
+
+  std::multiset<std::string> entries;
+  std::vector<Cond> conds;
+  conds.push_back(Cond("AgentId", "==", id));
+  conds.push_back(Cond("Time", ">=", t0));
+  QueryResult qr = db.Query("TwoRegionReactorEvents", &conds);
+  for (int i = 0; i < qr.rows.size(); i++) {
+    std::stringstream ss;
+    ss << std::hexfloat << qr.GetVal<int>("Time", i) << " "
+       << qr.GetVal<std::string>("Event", i) << " "
+       << qr.GetVal<int>("Region", i) << " " << qr.GetVal<int>("NAssem", i)
+       << " " << qr.GetVal<double>("Mass", i);
+    entries.insert(ss.str());
+  }
+  qr = db.Query("TimeSeriesPower", &conds);
+  for (int i = 0; i < qr.rows.size(); i++) {
+    std::stringstream ss;
+    ss << std::hexfloat << qr.GetVal<int>("Time", i) << " power "
+       << qr.GetVal<double>("Value", i);
+    entries.insert(ss.str());
+  }
+
+  std::string roles[] = {"SenderId", "ReceiverId"};
+  for (int r = 0; r < 2; r++) {
+    conds.clear();
+    conds.push_back(Cond(roles[r], "==", id));
+    conds.push_back(Cond("Time", ">=", t0));
+    qr = db.Query("Transactions", &conds);
+    for (int i = 0; i < qr.rows.size(); i++) {
+      std::stringstream ss;
+      ss << qr.GetVal<int>("Time", i) << " " << roles[r] << " "
+         << qr.GetVal<std::string>("Commodity", i) << " "
+         << ResourceEntry(dbs, qr.GetVal<int>("ResourceId", i));
+      entries.insert(ss.str());
+    }
+  }
+  return entries;
+}
+
+// tests that a reactor restarted from a mid-run snapshot - mid-cycle, with
+// fresh, core and spent fuel on hand - continues exactly as it would have
+// without the restart.
+TEST(TwoRegionReactorTests, RestartFromSnapshot) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>3</cycle_time>  "
+     "  <refuel_time>1</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_fresh> <val>1</val> <val>0</val> </n_assem_fresh>  "
+     "  <n_assem_region> <val>3</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  ";
+
+  int simdur = 25;
+  int t_snap = 10;
+  cyclus::MockSim full(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                       simdur);
+  cyclus::MockSim first(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                        t_snap);
+  cyclus::MockSim* sims[] = {&full, &first};
+  for (int i = 0; i < 2; i++) {
+    sims[i]->AddSource("uox").Finalize();
+    sims[i]->AddSource("mox").Finalize();
+    sims[i]->AddSink("waste").capacity(1).Finalize();
+    sims[i]->AddSink("spentmox").Finalize();
+    sims[i]->AddRecipe("uox", c_uox());
+    sims[i]->AddRecipe("mox", c_mox());
+    sims[i]->AddRecipe("spentuox", c_spentuox());
+    sims[i]->AddRecipe("spentmox", c_spentmox());
+  }
+  int id_full = full.Run();
+  int id = first.Run();
+
+  // every simulation ends with a snapshot, which the rest of the run is
+  // restarted from
+  cyclus::SqliteBack back(":memory:");
+  cyclus::SimInit si;
+  si.Restart(&first.db(), first.agent->context()->sim_id(), t_snap);
+  si.recorder()->RegisterBackend(&back);
+  cyclus::SimInfo info = si.context()->sim_info();
+  info.duration = simdur;
+  si.context()->InitSim(info);
+  si.timer()->RunSim();
+  si.recorder()->Flush();
+
+  std::multiset<std::string> want = Trajectory(full.db(), id_full, t_snap);
+  std::multiset<std::string> got = Trajectory(back, id, t_snap, &first.db());
+  EXPECT_FALSE(want.empty());
+  EXPECT_TRUE(want == got);
+}
+
+// tests that replaying a reactor's DRE trace outside of its simulation gives
+// the same events and power as the run it was traced in.
+TEST(TwoRegionReactorTests, DreTraceReplay) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>3</cycle_time>  "
+     "  <refuel_time>1</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_region> <val>3</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  ";
+  TempDir dir;
+  std::string prefix = dir.file("trace");
+  config += "  <dre_trace>" + prefix + "</dre_trace>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                      20);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddSink("waste").capacity(1).Finalize();
+  sim.AddSink("spentmox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  std::stringstream path;
+  path << prefix << "_" << id << ".trace";
+  TraceReplay replay(path.str());
+  int replay_id = replay.Run();
+
+  // the replayed reactor takes no part in an exchange, so has no transactions
+  std::multiset<std::string> want = Trajectory(sim.db(), id, 0);
+  std::multiset<std::string>::iterator it = want.begin();
+  while (it != want.end()) {
+    if (it->find("Id ") != std::string::npos) {
+      want.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  std::multiset<std::string> got = Trajectory(replay.db(), replay_id, 0);
+  EXPECT_FALSE(want.empty());
+  EXPECT_TRUE(want == got);
+  EXPECT_EQ(20, replay.calls(TraceReplay::REQUESTS));
+  EXPECT_LT(0, replay.calls(TraceReplay::TRADES));
+  EXPECT_LT(0, replay.calls(TraceReplay::ACCEPT));
+}
+
+// tests that a core with more than two regions orders, discharges and trades
+// each region's batches independently.
+TEST(TwoRegionReactorTests, ThreeRegionBatchSizes) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val> <val>mox</val> <val>uox</val> </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val> <val>mox</val> <val>blanket</val> </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val> <val>spentuox</val> </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> <val>3</val> </assem_size>  "
+     "  <n_assem_region> <val>7</val> <val>14</val> <val>5</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>2</val> <val>1</val> </n_assem_batch>  ";
+
+  int simdur = 50;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddSource("blanket").Finalize();
+  sim.AddSink("spentuox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  std::vector<cyclus::Cond> conds;
+  conds.push_back(cyclus::Cond("Commodity", "==", std::string("uox")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ(7+3*(simdur-1), qr.rows.size());
+
+  conds.clear();
+  conds.push_back(cyclus::Cond("Commodity", "==", std::string("mox")));
+  qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ(14+2*(simdur-1), qr.rows.size());
+
+  conds.clear();
+  conds.push_back(cyclus::Cond("Commodity", "==", std::string("blanket")));
+  qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ(5+1*(simdur-1), qr.rows.size());
+
+  // regions 1 and 3 share an outcommod - every discharged assembly from both
+  // must be traded exactly once.
+  conds.clear();
+  conds.push_back(cyclus::Cond("Commodity", "==", std::string("spentuox")));
+  qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ((3+1)*(simdur-1), qr.rows.size());
+}
+
+// tests that the spent fuel supply recorded after each discharge is the total
+// mass held in each region's spent fuel inventory.
+TEST(TwoRegionReactorTests, SpentSupplyTimeSeries) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_region> <val>7</val> <val>14</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>2</val> </n_assem_batch>  ";
+
+  int simdur = 5;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  // a batch is discharged from each region on every time step after the first
+  QueryResult qr = sim.db().Query("TimeSeriessupplyspentuox", NULL);
+  ASSERT_EQ(simdur-1, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    int t = qr.GetVal<int>("Time", i);
+    EXPECT_DOUBLE_EQ(3.0*t, qr.GetVal<double>("Value", i));
+  }
+
+  qr = sim.db().Query("TimeSeriessupplyspentmox", NULL);
+  ASSERT_EQ(simdur-1, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    int t = qr.GetVal<int>("Time", i);
+    EXPECT_DOUBLE_EQ(4.0*t, qr.GetVal<double>("Value", i));
+  }
+}
+
+// tests that reactor events are recorded with typed region, assembly count
+// and mass columns.
+TEST(TwoRegionReactorTests, RecordEvents) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_region> <val>7</val> <val>14</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>2</val> </n_assem_batch>  ";
+
+  int simdur = 10;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Event", "==", std::string("DISCHARGE")));
+  conds.push_back(Cond("Region", "==", 1));
+  QueryResult qr = sim.db().Query("TwoRegionReactorEvents", &conds);
+  ASSERT_EQ(simdur-1, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    EXPECT_EQ(2, qr.GetVal<int>("NAssem", i));
+    EXPECT_DOUBLE_EQ(4.0, qr.GetVal<double>("Mass", i));
+  }
+
+  // the initial core is loaded straight from the exchange in each region
+  conds.clear();
+  conds.push_back(Cond("Event", "==", std::string("LOAD")));
+  conds.push_back(Cond("Time", "==", 0));
+  qr = sim.db().Query("TwoRegionReactorEvents", &conds);
+  ASSERT_EQ(2, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    int region = qr.GetVal<int>("Region", i);
+    EXPECT_EQ(region == 0 ? 7 : 14, qr.GetVal<int>("NAssem", i));
+  }
+
+  conds.clear();
+  conds.push_back(Cond("Event", "==", std::string("CYCLE_START")));
+  qr = sim.db().Query("TwoRegionReactorEvents", &conds);
+  EXPECT_EQ(simdur, qr.rows.size());
+  EXPECT_EQ(-1, qr.GetVal<int>("Region"));
+}
+
 // tests that the refueling period between cycle end and start of the next
 // cycle is honored.
 TEST(TwoRegionReactorTests, RefuelTimes) {
@@ -255,23 +1043,99 @@ TEST(TwoRegionReactorTests, DecomZeroRefuel) {
      "  <n_assem_batch> <val>1</val> <val>1</val></n_assem_batch>  "
      "  <power_cap>1000</power_cap>";
 
-  int simdur = 8;
-  int lifetime = 6;
-  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur, lifetime);
+  int simdur = 8;
+  int lifetime = 6;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur, lifetime);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  // operating for 2+2 months and shutdown for 2+1
+  int on_time = 6;
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Value", "==", 1000));
+  QueryResult qr = sim.db().Query("TimeSeriesPower", &conds);
+  EXPECT_EQ(on_time, qr.rows.size());
+}
+
+// tests that a reactor with a full core and no fresh fuel inventory, which
+// skips the work of its mid-cycle time steps, still ends its cycles, refuels
+// and retires on time and records power on every operating time step.
+TEST(TwoRegionReactorTests, QuietMidCycle) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>3</cycle_time>  "
+     "  <refuel_time>1</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_region> <val>3</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  "
+     "  <power_cap>100</power_cap>  ";
+
+  int simdur = 24;
+  int lifetime = 18;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                      simdur, lifetime);
   sim.AddSource("uox").Finalize();
   sim.AddSource("mox").Finalize();
+  sim.AddSink("spentuox").Finalize();
+  sim.AddSink("spentmox").Finalize();
   sim.AddRecipe("uox", c_uox());
   sim.AddRecipe("mox", c_mox());
   sim.AddRecipe("spentuox", c_spentuox());
   sim.AddRecipe("spentmox", c_spentmox());
   int id = sim.Run();
 
-  // operating for 2+2 months and shutdown for 2+1
-  int on_time = 6;
+  // cycles of 3 time steps start every 4, with the last cut short by
+  // retirement at the end of t = 17
   std::vector<Cond> conds;
-  conds.push_back(Cond("Value", "==", 1000));
+  conds.push_back(Cond("AgentId", "==", id));
   QueryResult qr = sim.db().Query("TimeSeriesPower", &conds);
-  EXPECT_EQ(on_time, qr.rows.size());
+  ASSERT_EQ(lifetime, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    int t = qr.GetVal<int>("Time", i);
+    EXPECT_DOUBLE_EQ(t % 4 == 3 ? 0 : 100, qr.GetVal<double>("Value", i))
+        << "t = " << t;
+  }
+
+  std::map<std::string, std::set<int> > times;
+  qr = sim.db().Query("TwoRegionReactorEvents", &conds);
+  for (int i = 0; i < qr.rows.size(); i++) {
+    times[qr.GetVal<std::string>("Event", i)].insert(qr.GetVal<int>("Time", i));
+  }
+  // the whole core is discharged on retirement
+  int starts[] = {0, 4, 8, 12, 16};
+  int ends[] = {3, 7, 11, 15, 18};
+  EXPECT_EQ(std::set<int>(starts, starts + 5), times["CYCLE_START"]);
+  EXPECT_EQ(std::set<int>(ends, ends + 4), times["CYCLE_END"]);
+  EXPECT_EQ(std::set<int>(ends, ends + 5), times["DISCHARGE"]);
+  ASSERT_FALSE(times["RETIRED"].empty());
+  EXPECT_EQ(lifetime, *times["RETIRED"].begin());
+
+  // the last step of each quiet window, just before the Tick that ends the
+  // cycle, only records power - nothing is traded or recorded otherwise
+  for (int c = 0; c < 4; c++) {
+    int t = ends[c] - 1;
+    std::map<std::string, std::set<int> >::iterator it;
+    for (it = times.begin(); it != times.end(); ++it) {
+      EXPECT_EQ(0, it->second.count(t)) << it->first << " at t = " << t;
+    }
+    std::vector<Cond> at;
+    at.push_back(Cond("Time", "==", t));
+    at.push_back(Cond("ReceiverId", "==", id));
+    EXPECT_EQ(0, sim.db().Query("Transactions", &at).rows.size());
+    at[1] = Cond("AgentId", "==", id);
+    qr = sim.db().Query("TimeSeriesPower", &at);
+    ASSERT_EQ(1, qr.rows.size());
+    EXPECT_DOUBLE_EQ(100, qr.GetVal<double>("Value"));
+  }
 }
 
 // tests that new fuel is ordered immediately following cycle end - at the
@@ -343,6 +1207,106 @@ TEST(TwoRegionReactorTests, MultiFuelMix) {
   EXPECT_EQ(3*simdur+3, qr.rows.size());
 }
 
+// tests that aggregated per-region request portfolios still honor the fresh
+// fuel inventory constraints when several fuel types are requested.
+TEST(TwoRegionReactorTests, AggregateRequestsMultiFuelMix) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_fresh> <val>3</val> <val>0</val> </n_assem_fresh>  "
+     "  <n_assem_region> <val>3</val> <val>3</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>3</val> </n_assem_batch>  "
+     "  <aggregate_requests>1</aggregate_requests>  ";
+
+  int simdur = 50;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").capacity(2).Finalize();
+  sim.AddSource("mox").capacity(2).Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("mox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentuox());
+  int id = sim.Run();
+
+  QueryResult qr = sim.db().Query("Transactions", NULL);
+  // +3 is for fresh fuel inventory
+  EXPECT_EQ(3*simdur+3, qr.rows.size());
+}
+
+// tests that aggregating each region's requests into a single portfolio
+// produces the same trades on every time step as placing one portfolio per
+// assembly, including while fuel is in short supply.
+TEST(TwoRegionReactorTests, AggregateRequestsSameTrades) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>7</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>2</val> </assem_size>  "
+     "  <n_assem_fresh> <val>2</val> <val>1</val> </n_assem_fresh>  "
+     "  <n_assem_region> <val>3</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>2</val> </n_assem_batch>  ";
+  std::string config_agg =
+      config + "  <aggregate_requests>1</aggregate_requests>  ";
+
+  int simdur = 50;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").lifetime(1).Finalize();
+  sim.AddSource("mox").lifetime(1).Finalize();
+  sim.AddSource("uox").start(9).lifetime(1).capacity(2).Finalize();
+  sim.AddSource("mox").start(9).lifetime(1).capacity(2).Finalize();
+  sim.AddSource("uox").start(15).Finalize();
+  sim.AddSource("mox").start(15).Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddSink("spentmox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  cyclus::MockSim sim_agg(cyclus::AgentSpec(":areal:TwoRegionReactor"), config_agg, simdur);
+  sim_agg.AddSource("uox").lifetime(1).Finalize();
+  sim_agg.AddSource("mox").lifetime(1).Finalize();
+  sim_agg.AddSource("uox").start(9).lifetime(1).capacity(2).Finalize();
+  sim_agg.AddSource("mox").start(9).lifetime(1).capacity(2).Finalize();
+  sim_agg.AddSource("uox").start(15).Finalize();
+  sim_agg.AddSource("mox").start(15).Finalize();
+  sim_agg.AddSink("waste").Finalize();
+  sim_agg.AddSink("spentmox").Finalize();
+  sim_agg.AddRecipe("uox", c_uox());
+  sim_agg.AddRecipe("mox", c_mox());
+  sim_agg.AddRecipe("spentuox", c_spentuox());
+  sim_agg.AddRecipe("spentmox", c_spentmox());
+  int id_agg = sim_agg.Run();
+
+  QueryResult qr = sim.db().Query("Transactions", NULL);
+  QueryResult qr_agg = sim_agg.db().Query("Transactions", NULL);
+  EXPECT_EQ(qr.rows.size(), qr_agg.rows.size());
+
+  std::string commods[] = {"uox", "mox", "waste", "spentmox"};
+  for (int t = 0; t < simdur; t++) {
+    for (int i = 0; i < 4; i++) {
+      std::vector<Cond> conds;
+      conds.push_back(Cond("Time", "==", t));
+      conds.push_back(Cond("Commodity", "==", commods[i]));
+      qr = sim.db().Query("Transactions", &conds);
+      qr_agg = sim_agg.db().Query("Transactions", &conds);
+      EXPECT_EQ(qr.rows.size(), qr_agg.rows.size())
+          << "different " << commods[i] << " trades at time " << t;
+    }
+  }
+}
+
 // tests that the reactor halts operation when it has no more room in its
 // spent fuel inventory buffer. 1 test per spent buffer and 1 test for 
 // small capacity on both spent buffers
@@ -775,6 +1739,253 @@ TEST(TwoRegionReactorTests, DischargedFuelTransmute) {
   EXPECT_TRUE(mq2.mass(942390000) > 0) << "transmuted spent fuel doesn't have Pu239";
 }
 
+// tests that with several batches in a region the batch discharged each
+// cycle is always the one that was transmuted, i.e. the oldest in the core.
+TEST(TwoRegionReactorTests, DischargedBatchesTransmute) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>3</val> <val>4</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>2</val> </n_assem_batch>  ";
+
+  int simdur = 12;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddSink("spentmox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  Composition::Ptr spentuox = c_spentuox();
+  sim.AddRecipe("spentuox", spentuox);
+  Composition::Ptr spentmox = c_spentmox();
+  sim.AddRecipe("spentmox", spentmox);
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ(simdur - 1, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_EQ(spentuox->id(), m->comp()->id());
+  }
+
+  conds.clear();
+  conds.push_back(Cond("Commodity", "==", std::string("spentmox")));
+  qr = sim.db().Query("Transactions", &conds);
+  EXPECT_EQ(2 * (simdur - 1), qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_EQ(spentmox->id(), m->comp()->id());
+  }
+}
+
+// tests that regions with a depletion matrix discharge fuel depleted by one
+// matrix step per time step of irradiation, and that assemblies that were
+// irradiated alike share one depleted composition.
+TEST(TwoRegionReactorTests, DepletionMatrix) {
+  TempDir dir;
+  std::string matfile = dir.file("depletion.txt");
+  std::ofstream f(matfile.c_str());
+  f << "# from to fraction\n"
+    << "u235 u235 0.9\n"
+    << "u235 pu239 0.1\n";
+  f.close();
+
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val> <val>spentmox</val>  </fuel_outcommods>  "
+     "  <depletion_files> <val>" + matfile + "</val> <val>" + matfile +
+     "</val> </depletion_files>  "
+     ""
+     "  <cycle_time>3</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>1</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>2</val> </n_assem_batch>  ";
+
+  int simdur = 10;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddSink("spentmox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+
+  // three steps of irradiation per cycle
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(3, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    MatQuery mq(m);
+    EXPECT_NEAR(0.04 * 0.729, mq.mass(922350000), 1e-9);
+    EXPECT_NEAR(0.04 * 0.271, mq.mass(942390000), 1e-9);
+    EXPECT_NEAR(0.96, mq.mass(922380000), 1e-9);
+  }
+
+  conds.clear();
+  conds.push_back(Cond("Commodity", "==", std::string("spentmox")));
+  qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(6, qr.rows.size());
+  int comp_id = sim.GetMaterial(qr.GetVal<int>("ResourceId", 0))->comp()->id();
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_EQ(comp_id, m->comp()->id());
+  }
+}
+
+// tests that a depletion matrix file rewritten between simulations is read
+// again by the later simulation, and that a matrix whose fractions for a
+// nuclide do not sum to one is rejected.
+TEST(TwoRegionReactorTests, DepletionMatrixReread) {
+  TempDir dir;
+  std::string matfile = dir.file("depletion.txt");
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     "  <depletion_files> <val>" + matfile + "</val> </depletion_files>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>1</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> </n_assem_batch>  ";
+
+  // one step of irradiation per cycle
+  double retained[] = {0.5, 0.8};
+  for (int run = 0; run < 2; run++) {
+    std::ofstream f(matfile.c_str());
+    f << "u235 u235 " << retained[run] << "\n"
+      << "u235 pu239 " << 1 - retained[run] << "\n";
+    f.close();
+
+    cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                        3);
+    sim.AddSource("uox").Finalize();
+    sim.AddSink("waste").Finalize();
+    sim.AddRecipe("uox", c_uox());
+    sim.AddRecipe("spentuox", c_spentuox());
+    sim.Run();
+
+    std::vector<Cond> conds;
+    conds.push_back(Cond("Commodity", "==", std::string("waste")));
+    QueryResult qr = sim.db().Query("Transactions", &conds);
+    ASSERT_LT(0, qr.rows.size());
+    MatQuery mq(sim.GetMaterial(qr.GetVal<int>("ResourceId", 0)));
+    EXPECT_NEAR(0.04 * retained[run], mq.mass(922350000), 1e-9);
+    EXPECT_NEAR(0.04 * (1 - retained[run]), mq.mass(942390000), 1e-9);
+  }
+
+  std::ofstream f(matfile.c_str());
+  f << "u235 u235 0.9\n";
+  f.close();
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 3);
+  sim.AddSource("uox").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  EXPECT_THROW(sim.Run(), cyclus::ValueError);
+}
+
+// tests that a region with a burnup library discharges fuel with the
+// library's composition interpolated to the time the fuel was irradiated.
+TEST(TwoRegionReactorTests, BurnupLibrary) {
+  TempDir dir;
+  std::string libfile = dir.file("burnup.txt");
+  std::ofstream f(libfile.c_str());
+  f << "# steps nuclide mass\n"
+    << "0 u235 4\n"
+    << "0 u238 96\n"
+    << "4 u235 2\n"
+    << "4 u238 96\n"
+    << "4 pu239 2\n";
+  f.close();
+
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     "  <burnup_libraries> <val>" + libfile + "</val> </burnup_libraries>  "
+     ""
+     "  <cycle_time>2</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>3</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> </n_assem_batch>  ";
+
+  int simdur = 7;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSink("waste").Finalize();
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  int id = sim.Run();
+
+  // two steps of irradiation per cycle is halfway between the entries
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  ASSERT_EQ(9, qr.rows.size());
+  int comp_id = sim.GetMaterial(qr.GetVal<int>("ResourceId", 0))->comp()->id();
+  for (int i = 0; i < qr.rows.size(); i++) {
+    Material::Ptr m = sim.GetMaterial(qr.GetVal<int>("ResourceId", i));
+    EXPECT_EQ(comp_id, m->comp()->id());
+    MatQuery mq(m);
+    EXPECT_NEAR(0.03, mq.mass(922350000), 1e-9);
+    EXPECT_NEAR(0.96, mq.mass(922380000), 1e-9);
+    EXPECT_NEAR(0.01, mq.mass(942390000), 1e-9);
+  }
+}
+
+// tests that a burnup library is shared by every load in a simulation and
+// gives its first and last entries for burnups outside the ones it covers.
+TEST(TwoRegionReactorTests, BurnupLibraryBounds) {
+  TempDir dir;
+  std::string libfile = dir.file("burnup.txt");
+  std::ofstream f(libfile.c_str());
+  f << "2 u235 4\n"
+    << "2 u238 96\n"
+    << "4 u235 2\n"
+    << "4 u238 98\n";
+  f.close();
+
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    </fuel_outcommods>  "
+     "  <assem_size> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>1</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> </n_assem_batch>  ";
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 1);
+  cyclus::Context* ctx = sim.agent->context();
+
+  BurnupLibrary::Ptr lib = BurnupLibrary::Load(ctx, libfile);
+  EXPECT_EQ(lib, BurnupLibrary::Load(ctx, libfile));
+  EXPECT_EQ(lib->Spent(2), lib->Spent(0));
+  EXPECT_EQ(lib->Spent(4), lib->Spent(10));
+  MatQuery mq(Material::CreateUntracked(1, lib->Spent(3)));
+  EXPECT_NEAR(0.03, mq.mass(922350000), 1e-9);
+  EXPECT_NEAR(0.97, mq.mass(922380000), 1e-9);
+}
+
 // tests that spent fuel is offerred on correct commods according to the
 // incommod it was received on
 TEST(TwoRegionReactorTests, SpentFuelProperCommodTracking) {
@@ -816,6 +2027,255 @@ TEST(TwoRegionReactorTests, SpentFuelProperCommodTracking) {
   EXPECT_EQ(12, qr.rows.size());
 }
 
+// tests that over a 100 year run every assembly that leaves the core is traded
+// away, so the reactor only ever holds its core and keeps no record of fuel
+// it no longer holds.  Fuel is tagged with its region by the inventory that
+// holds it, so restart snapshots also stay the same size.
+TEST(TwoRegionReactorTests, LongRunBoundedInventory) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste1</val>   <val>waste2</val>   </fuel_outcommods>  "
+     ""
+     "  <cycle_time>3</cycle_time>  "
+     "  <refuel_time>1</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>3</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  ";
+
+  // both runs end on a discharge step (t = 19 and 1199)
+  int simdur = 1200;
+  int early_dur = 20;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  cyclus::MockSim early(cyclus::AgentSpec(":areal:TwoRegionReactor"), config,
+                        early_dur);
+  cyclus::MockSim* sims[] = {&sim, &early};
+  for (int i = 0; i < 2; i++) {
+    sims[i]->AddSource("uox").Finalize();
+    sims[i]->AddSource("mox").Finalize();
+    sims[i]->AddSink("waste1").Finalize();
+    sims[i]->AddSink("waste2").Finalize();
+    sims[i]->AddRecipe("uox", c_uox());
+    sims[i]->AddRecipe("spentuox", c_spentuox());
+    sims[i]->AddRecipe("mox", c_mox());
+    sims[i]->AddRecipe("spentmox", c_spentmox());
+  }
+  int id = sim.Run();
+  early.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("ReceiverId", "==", id));
+  int n_recv = sim.db().Query("Transactions", &conds).rows.size();
+
+  conds.clear();
+  conds.push_back(Cond("SenderId", "==", id));
+  int n_sent = sim.db().Query("Transactions", &conds).rows.size();
+
+  // one batch per region discharged at t = 3, 7, 11, ...
+  int n_discharge = (simdur - 1 - 3) / 4 + 1;
+  EXPECT_EQ(2 * n_discharge, n_sent);
+  // only the full core is left in the reactor
+  EXPECT_EQ(3 + 2, n_recv - n_sent);
+
+  // the snapshot taken at the end of the long run holds exactly what one
+  // taken at the same point of an early cycle does
+  cyclus::Inventories late_inv = sim.agent->SnapshotInv();
+  cyclus::Inventories early_inv = early.agent->SnapshotInv();
+  ASSERT_EQ(early_inv.size(), late_inv.size());
+  int n_late = 0;
+  cyclus::Inventories::iterator it;
+  for (it = early_inv.begin(); it != early_inv.end(); ++it) {
+    EXPECT_EQ(it->second.size(), late_inv[it->first].size()) << it->first;
+    n_late += late_inv[it->first].size();
+  }
+  EXPECT_EQ(3 + 2, n_late);
+}
+
+// tests that pruned bids still trade away every spent assembly when many
+// small requests are made for it, and that the trades match unpruned bidding.
+TEST(TwoRegionReactorTests, PruneBids) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>      <val>mox</val>      </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>      <val>mox</val>      </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val>    <val>waste</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>3</val> <val>2</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>3</val> <val>1</val> </n_assem_batch>  ";
+  std::string config_prune = config + "  <prune_bids>1</prune_bids>  ";
+
+  // more requests than assemblies are discharged each time step
+  int simdur = 20;
+  int nsinks = 6;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, simdur);
+  cyclus::MockSim sim_prune(cyclus::AgentSpec(":areal:TwoRegionReactor"), config_prune, simdur);
+  sim.AddSource("uox").Finalize();
+  sim.AddSource("mox").Finalize();
+  sim_prune.AddSource("uox").Finalize();
+  sim_prune.AddSource("mox").Finalize();
+  for (int i = 0; i < nsinks; i++) {
+    sim.AddSink("waste").capacity(1).Finalize();
+    sim_prune.AddSink("waste").capacity(1).Finalize();
+  }
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  sim_prune.AddRecipe("uox", c_uox());
+  sim_prune.AddRecipe("mox", c_mox());
+  sim_prune.AddRecipe("spentuox", c_spentuox());
+  sim_prune.AddRecipe("spentmox", c_spentmox());
+  int id = sim.Run();
+  int id_prune = sim_prune.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Commodity", "==", std::string("waste")));
+  QueryResult qr = sim.db().Query("Transactions", &conds);
+  QueryResult qr_prune = sim_prune.db().Query("Transactions", &conds);
+  EXPECT_EQ((3+1)*(simdur-1), qr_prune.rows.size());
+  EXPECT_EQ(qr.rows.size(), qr_prune.rows.size());
+
+  // nothing is left over in the spent fuel inventory
+  conds.clear();
+  conds.push_back(Cond("ReceiverId", "==", id_prune));
+  int n_recv = sim_prune.db().Query("Transactions", &conds).rows.size();
+  conds.clear();
+  conds.push_back(Cond("SenderId", "==", id_prune));
+  int n_sent = sim_prune.db().Query("Transactions", &conds).rows.size();
+  EXPECT_EQ(3 + 2, n_recv - n_sent);
+}
+
+// tests that pruned bids offer every request bid on the oldest assemblies, so
+// that when the first request bid on is filled by another supplier the oldest
+// spent fuel still goes to the others, and the rest is bid on again.
+TEST(TwoRegionReactorTests, PruneBidsNotPinned) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>uox</val>  <val>mox</val>    </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>spentuox</val> <val>spentmox</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>uox</val>   <val>mox</val>   </fuel_incommods>  "
+     "  <fuel_outcommods> <val>spentuox</val> <val>spentmox</val>  </fuel_outcommods>  "
+     ""
+     "  <cycle_time>1</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>1</val> <val>1</val> </assem_size>  "
+     "  <n_assem_region> <val>1</val> <val>1</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>1</val> <val>1</val> </n_assem_batch>  "
+     "  <prune_bids>1</prune_bids>  ";
+
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, 10);
+  sim.AddRecipe("uox", c_uox());
+  sim.AddRecipe("mox", c_mox());
+  sim.AddRecipe("spentuox", c_spentuox());
+  sim.AddRecipe("spentmox", c_spentmox());
+  cyclus::Context* ctx = sim.agent->context();
+
+  cyclus::Agent* a = sim.agent->Clone();
+  a->Build(NULL);
+  cyclus::Inventories invs;
+  std::vector<Material::Ptr> spent;
+  for (int j = 0; j < 3; j++) {
+    spent.push_back(Material::Create(a, 1, ctx->GetRecipe("spentuox")));
+    invs["spent1"].push_back(spent.back());
+  }
+  a->InitInv(invs);
+  cyclus::Trader* r = dynamic_cast<cyclus::Trader*>(a);
+
+  // five one-assembly requests for three assemblies
+  cyclus::RequestPortfolio<Material>::Ptr rport(
+      new cyclus::RequestPortfolio<Material>());
+  cyclus::CommodMap<Material>::type commod_requests;
+  std::vector<cyclus::Request<Material>*> reqs;
+  for (int j = 0; j < 5; j++) {
+    reqs.push_back(rport->AddRequest(spent.back(), r, "spentuox"));
+    commod_requests["spentuox"].push_back(reqs.back());
+  }
+
+  std::set<cyclus::BidPortfolio<Material>::Ptr> ports =
+      r->GetMatlBids(commod_requests);
+  ASSERT_EQ(1, ports.size());
+  const std::set<cyclus::Bid<Material>*>& bids = (*ports.begin())->bids();
+  ASSERT_EQ(3, bids.size());
+  std::map<cyclus::Request<Material>*, cyclus::Bid<Material>*> bid_on;
+  std::set<cyclus::Bid<Material>*>::const_iterator it;
+  for (it = bids.begin(); it != bids.end(); ++it) {
+    EXPECT_EQ(spent[0], (*it)->offer());
+    bid_on[(*it)->request()] = *it;
+  }
+  ASSERT_EQ(3, bid_on.size());
+  for (int j = 0; j < 3; j++) {
+    EXPECT_EQ(1, bid_on.count(reqs[j]));
+  }
+
+  // the first request goes to another supplier
+  std::vector<cyclus::Trade<Material> > trades;
+  for (int j = 1; j < 3; j++) {
+    trades.push_back(cyclus::Trade<Material>(reqs[j], bid_on[reqs[j]], 1));
+  }
+  std::vector<std::pair<cyclus::Trade<Material>, Material::Ptr> > responses;
+  r->GetMatlTrades(trades, responses);
+  ASSERT_EQ(2, responses.size());
+  EXPECT_EQ(spent[0], responses[0].second);
+  EXPECT_EQ(spent[1], responses[1].second);
+
+  // the assembly left over is offered to the requests left
+  commod_requests["spentuox"].assign(reqs.begin() + 3, reqs.end());
+  ports = r->GetMatlBids(commod_requests);
+  ASSERT_EQ(1, ports.size());
+  ASSERT_EQ(1, (*ports.begin())->bids().size());
+  cyclus::Bid<Material>* bid = *(*ports.begin())->bids().begin();
+  EXPECT_EQ(spent[2], bid->offer());
+  EXPECT_EQ(reqs[3], bid->request());
+}
+
+// tests that a retiring reactor empties each region's core into spent fuel
+// in one discharge, with one event and one supply record per region.
+TEST(TwoRegionReactorTests, RetireBulkDischarge) {
+  std::string config =
+     "  <fuel_inrecipes>  <val>lwr_fresh</val> <val>bwr_fresh</val> </fuel_inrecipes>  "
+     "  <fuel_outrecipes> <val>lwr_spent</val> <val>bwr_spent</val> </fuel_outrecipes>  "
+     "  <fuel_incommods>  <val>enriched_u</val> <val>enriched_pu</val> </fuel_incommods>  "
+     "  <fuel_outcommods> <val>waste</val> <val>spent_pu</val>    </fuel_outcommods>  "
+     ""
+     "  <cycle_time>10</cycle_time>  "
+     "  <refuel_time>0</refuel_time>  "
+     "  <assem_size> <val>300</val> <val>150</val> </assem_size>  "
+     "  <n_assem_region> <val>6</val> <val>4</val> </n_assem_region>  "
+     "  <n_assem_batch> <val>2</val> <val>1</val> </n_assem_batch>  ";
+
+  int dur = 10;
+  int life = 5;
+  cyclus::MockSim sim(cyclus::AgentSpec(":areal:TwoRegionReactor"), config, dur, life);
+  sim.AddSource("enriched_u").Finalize();
+  sim.AddSource("enriched_pu").Finalize();
+  sim.AddRecipe("lwr_fresh", c_uox());
+  sim.AddRecipe("bwr_fresh", c_mox());
+  sim.AddRecipe("lwr_spent", c_spentuox());
+  sim.AddRecipe("bwr_spent", c_spentmox());
+  int id = sim.Run();
+
+  std::vector<Cond> conds;
+  conds.push_back(Cond("Event", "==", std::string("DISCHARGE")));
+  QueryResult qr = sim.db().Query("TwoRegionReactorEvents", &conds);
+  ASSERT_EQ(2, qr.rows.size());
+  for (int i = 0; i < qr.rows.size(); i++) {
+    int region = qr.GetVal<int>("Region", i);
+    EXPECT_EQ(life, qr.GetVal<int>("Time", i));
+    EXPECT_EQ(region == 0 ? 6 : 4, qr.GetVal<int>("NAssem", i));
+  }
+
+  qr = sim.db().Query("TimeSeriessupplywaste", NULL);
+  ASSERT_EQ(1, qr.rows.size());
+  EXPECT_DOUBLE_EQ(6 * 300.0, qr.GetVal<double>("Value"));
+
+  qr = sim.db().Query("TimeSeriessupplyspent_pu", NULL);
+  ASSERT_EQ(1, qr.rows.size());
+  EXPECT_DOUBLE_EQ(4 * 150.0, qr.GetVal<double>("Value"));
+}
+
 // The user can optionally omit fuel preferences.  In the case where
 // preferences are adjusted, the ommitted preference vector must be populated
 // with default values - if it wasn't then preferences won't be adjusted
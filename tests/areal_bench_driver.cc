@@ -0,0 +1,19 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "env.h"
+#include "logger.h"
+
+int main(int argc, char* argv[]) {
+  // tell ENV the path between the cwd and the cyclus executable
+  std::string path = cyclus::Env::PathBase(argv[0]);
+  cyclus::Logger::ReportLevel() = cyclus::LEV_ERROR;
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
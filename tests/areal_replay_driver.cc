@@ -0,0 +1,44 @@
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "env.h"
+#include "error.h"
+#include "logger.h"
+#include "tworegionreactor_replay.h"
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <trace file>\n";
+    return 1;
+  }
+
+  // tell ENV the path between the cwd and the cyclus executable
+  std::string path = cyclus::Env::PathBase(argv[0]);
+  cyclus::Logger::ReportLevel() = cyclus::LEV_ERROR;
+
+  static const char* names[] = {"GetMatlRequests", "GetMatlBids",
+                                "GetMatlTrades", "AcceptMatlTrades"};
+  try {
+    areal::TraceReplay replay(argv[1]);
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    replay.Run();
+    std::chrono::duration<double> wall =
+        std::chrono::steady_clock::now() - start;
+
+    std::printf("%-18s %8s %12s\n", "callback", "calls", "seconds");
+    for (int p = 0; p < areal::TraceReplay::N_PHASES; p++) {
+      areal::TraceReplay::Phase phase =
+          static_cast<areal::TraceReplay::Phase>(p);
+      std::printf("%-18s %8d %12.6f\n", names[p], replay.calls(phase),
+                  replay.seconds(phase));
+    }
+    std::printf("%-18s %8s %12.6f\n", "total wall", "", wall.count());
+  } catch (cyclus::Error& e) {
+    std::cerr << argv[0] << ": " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
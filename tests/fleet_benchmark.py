@@ -0,0 +1,221 @@
+#!/usr/bin/python3
+"""Fleet-scale throughput benchmark for the TwoRegionReactor.
+
+Generates scenarios of many identical TwoRegionReactors fed by cycamore
+Sources and emptied by cycamore Sinks, runs each with cyclus, and reports
+wall time, peak RSS and simulated reactor-years per second.
+
+    $ python3 fleet_benchmark.py --reactors 1 10 100 1000 --duration 720
+"""
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+MONTHS_PER_YEAR = 12
+
+SCENARIO = """<simulation>
+  <control>
+    <duration>{duration}</duration>
+    <startmonth>1</startmonth>
+    <startyear>2000</startyear>
+  </control>
+
+  <archetypes>
+    <spec><lib>areal</lib><name>TwoRegionReactor</name></spec>
+    <spec><lib>cycamore</lib><name>Source</name></spec>
+    <spec><lib>cycamore</lib><name>Sink</name></spec>
+    <spec><lib>agents</lib><name>NullInst</name></spec>
+    <spec><lib>agents</lib><name>NullRegion</name></spec>
+  </archetypes>
+
+  <facility>
+    <name>USource</name>
+    <config> <Source> <outcommod>fresh_u</outcommod> </Source> </config>
+  </facility>
+  <facility>
+    <name>BlanketSource</name>
+    <config> <Source> <outcommod>fresh_blanket</outcommod> </Source> </config>
+  </facility>
+
+  <facility>
+    <name>Reactor</name>
+    <config>
+      <TwoRegionReactor>
+        <fuel_incommods> <val>fresh_u</val> <val>fresh_blanket</val> </fuel_incommods>
+        <fuel_inrecipes> <val>fresh_uranium</val> <val>fresh_blanket</val> </fuel_inrecipes>
+        <fuel_outcommods> <val>spent_u</val> <val>spent_blanket</val> </fuel_outcommods>
+        <fuel_outrecipes> <val>spent_uranium</val> <val>spent_blanket</val> </fuel_outrecipes>
+        <cycle_time>{cycle_time}</cycle_time>
+        <refuel_time>{refuel_time}</refuel_time>
+        <assem_size> <val>100</val> <val>50</val> </assem_size>
+        <n_assem_region> <val>{n_region}</val> <val>{n_region}</val> </n_assem_region>
+        <n_assem_batch> <val>{n_batch}</val> <val>{n_batch}</val> </n_assem_batch>
+        <power_cap>1000</power_cap>{depletion}
+      </TwoRegionReactor>
+    </config>
+  </facility>
+
+  <facility>
+    <name>USink</name>
+    <config> <Sink> <in_commods> <val>spent_u</val> </in_commods> </Sink> </config>
+  </facility>
+  <facility>
+    <name>BlanketSink</name>
+    <config> <Sink> <in_commods> <val>spent_blanket</val> </in_commods> </Sink> </config>
+  </facility>
+
+  <region>
+    <name>FleetRegion</name>
+    <config> <NullRegion /> </config>
+    <institution>
+      <name>FleetInst</name>
+      <initialfacilitylist>
+        <entry> <prototype>USource</prototype> <number>1</number> </entry>
+        <entry> <prototype>BlanketSource</prototype> <number>1</number> </entry>
+        <entry> <prototype>Reactor</prototype> <number>{n_reactors}</number> </entry>
+        <entry> <prototype>USink</prototype> <number>1</number> </entry>
+        <entry> <prototype>BlanketSink</prototype> <number>1</number> </entry>
+      </initialfacilitylist>
+      <config> <NullInst /> </config>
+    </institution>
+  </region>
+
+  <recipe>
+    <name>fresh_uranium</name>
+    <basis>mass</basis>
+    <nuclide> <id>92235</id> <comp>0.04</comp> </nuclide>
+    <nuclide> <id>92238</id> <comp>0.96</comp> </nuclide>
+  </recipe>
+  <recipe>
+    <name>spent_uranium</name>
+    <basis>mass</basis>
+    <nuclide> <id>92235</id> <comp>0.01</comp> </nuclide>
+    <nuclide> <id>92238</id> <comp>0.98</comp> </nuclide>
+    <nuclide> <id>94239</id> <comp>0.01</comp> </nuclide>
+  </recipe>
+  <recipe>
+    <name>fresh_blanket</name>
+    <basis>mass</basis>
+    <nuclide> <id>92235</id> <comp>0.00711</comp> </nuclide>
+    <nuclide> <id>92238</id> <comp>0.99289</comp> </nuclide>
+  </recipe>
+  <recipe>
+    <name>spent_blanket</name>
+    <basis>mass</basis>
+    <nuclide> <id>92235</id> <comp>0.005</comp> </nuclide>
+    <nuclide> <id>92238</id> <comp>0.985</comp> </nuclide>
+    <nuclide> <id>94239</id> <comp>0.01</comp> </nuclide>
+  </recipe>
+</simulation>
+"""
+
+# a small per-month transmutation matrix, used by both regions with --depletion
+DEPLETION_MATRIX = """# from to fraction
+92235 92235 0.9993
+92235 92236 0.0002
+92235 94239 0.0005
+92238 92238 0.99995
+92238 94239 0.00005
+94239 94239 0.9997
+94239 94240 0.0003
+"""
+
+
+def write_depletion(path):
+    """Writes the depletion matrix file and returns the scenario snippet that
+    names it for both regions."""
+    matfile = os.path.join(path, "depletion.txt")
+    with open(matfile, "w") as f:
+        f.write(DEPLETION_MATRIX)
+    return ("\n        <depletion_files> <val>{0}</val> <val>{0}</val> "
+            "</depletion_files>".format(matfile))
+
+
+def write_scenario(path, n_reactors, args):
+    """Writes a fleet scenario input file and returns its path."""
+    n_region = max(1, args.core_size // 2)
+    n_batch = max(1, n_region // args.batches)
+    infile = os.path.join(path, "fleet_{0}.xml".format(n_reactors))
+    depletion = write_depletion(path) if args.depletion else ""
+    with open(infile, "w") as f:
+        f.write(SCENARIO.format(duration=args.duration,
+                                cycle_time=args.cycle_time,
+                                refuel_time=args.refuel_time,
+                                n_region=n_region,
+                                n_batch=n_batch,
+                                n_reactors=n_reactors,
+                                depletion=depletion))
+    return infile
+
+
+def run_scenario(cyclus, infile, outfile):
+    """Runs one scenario and returns its wall time (s) and peak RSS (MiB).
+
+    Each scenario runs in its own child process, which is reaped with
+    os.wait4 so that the peak RSS is that child's alone rather than the
+    maximum over every child run so far.
+    """
+    start = time.perf_counter()
+    proc = subprocess.Popen([cyclus, infile, "-o", outfile],
+                            stdout=subprocess.DEVNULL)
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.perf_counter() - start
+    # the child is already reaped, so record its exit code on proc directly
+    proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+    if proc.returncode != 0:
+        sys.exit("cyclus failed on " + infile)
+    # ru_maxrss is in KiB on Linux
+    return wall, usage.ru_maxrss / 1024.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--reactors", type=int, nargs="+",
+                        default=[1, 10, 100],
+                        help="reactor counts to run, one scenario each")
+    parser.add_argument("--core-size", type=int, default=200,
+                        help="assemblies per core, split over two regions")
+    parser.add_argument("--batches", type=int, default=3,
+                        help="batches per region")
+    parser.add_argument("--duration", type=int, default=720,
+                        help="simulation duration in months")
+    parser.add_argument("--cycle-time", type=int, default=18,
+                        help="cycle length in months")
+    parser.add_argument("--refuel-time", type=int, default=1,
+                        help="refueling outage in months")
+    parser.add_argument("--depletion", action="store_true",
+                        help="deplete fuel with a transmutation matrix "
+                             "instead of static spent fuel recipes")
+    parser.add_argument("--cyclus", default=shutil.which("cyclus") or "cyclus",
+                        help="cyclus executable")
+    parser.add_argument("--keep", metavar="DIR", default=None,
+                        help="keep generated inputs and outputs in DIR")
+    args = parser.parse_args()
+
+    workdir = args.keep or tempfile.mkdtemp(prefix="areal_fleet_")
+    if not os.path.exists(workdir):
+        os.makedirs(workdir)
+
+    print("{0:>9} {1:>10} {2:>12} {3:>15}".format(
+        "reactors", "wall (s)", "peak RSS MiB", "reactor-yr/s"))
+    try:
+        for n in sorted(args.reactors):
+            infile = write_scenario(workdir, n, args)
+            outfile = os.path.join(workdir, "fleet_{0}.sqlite".format(n))
+            if os.path.exists(outfile):
+                os.remove(outfile)
+            wall, peak = run_scenario(args.cyclus, infile, outfile)
+            reactor_years = n * args.duration / float(MONTHS_PER_YEAR)
+            print("{0:>9} {1:>10.2f} {2:>12.1f} {3:>15.1f}".format(
+                n, wall, peak, reactor_years / wall))
+    finally:
+        if args.keep is None:
+            shutil.rmtree(workdir)
+
+
+if __name__ == "__main__":
+    main()